@@ -0,0 +1,1777 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <utility>
+#include "BVH.h"
+#include "ThreadPool.h"
+
+namespace dae
+{
+	//Builds over fewer primitives stay on the calling thread, handing them out would cost more than it saves
+	static constexpr uint32_t PARALLEL_BUILD_MIN_PRIMITIVES = 32 * 1024;
+	//Smallest range of primitives a thread reduces or partitions on its own
+	static constexpr uint32_t PARALLEL_CHUNK_SIZE = 4096;
+	//Nodes this big are partitioned stably, which parallelizes and gives the same order on any number of threads.
+	//The top of a parallel build splits nodes down to this size before handing out subtrees.
+	static constexpr uint32_t STABLE_PARTITION_MIN_PRIMITIVES = 16 * 1024;
+
+	static ThreadPool* g_pBuildThreadPool{};
+	static BVHBuildMode g_DefaultBuildMode{ BVHBuildMode::SAH };
+
+	static ThreadPool* GetBuildThreadPool(uint32_t primitiveCount)
+	{
+		if (!g_pBuildThreadPool || g_pBuildThreadPool->GetThreadCount() == 1 || primitiveCount < PARALLEL_BUILD_MIN_PRIMITIVES)
+			return nullptr;
+		return g_pBuildThreadPool;
+	}
+
+	static uint32_t GetChunkCount(ThreadPool* pThreadPool, uint32_t count)
+	{
+		if (!pThreadPool)
+			return 1;
+		return std::clamp(count / PARALLEL_CHUNK_SIZE, 1u, pThreadPool->GetThreadCount() * 4);
+	}
+
+	static bool ContainsBounds(const BVHNode& parent, const BVHNode& child)
+	{
+		return child.minAABB.x >= parent.minAABB.x && child.minAABB.y >= parent.minAABB.y && child.minAABB.z >= parent.minAABB.z
+			&& child.maxAABB.x <= parent.maxAABB.x && child.maxAABB.y <= parent.maxAABB.y && child.maxAABB.z <= parent.maxAABB.z;
+	}
+
+	//Runs task(chunkIndex, begin, end) over [0, count) split into GetChunkCount chunks, on the pool when there is one
+	template<typename Task>
+	static void ForEachChunk(ThreadPool* pThreadPool, uint32_t count, Task&& task)
+	{
+		const uint32_t chunkCount = GetChunkCount(pThreadPool, count);
+		if (chunkCount == 1)
+		{
+			task(0u, 0u, count);
+			return;
+		}
+
+		pThreadPool->ParallelFor(chunkCount, [&](uint32_t chunkIndex)
+			{
+				const uint32_t begin = static_cast<uint32_t>(uint64_t{ count } * chunkIndex / chunkCount);
+				const uint32_t end = static_cast<uint32_t>(uint64_t{ count } * (chunkIndex + 1) / chunkCount);
+				task(chunkIndex, begin, end);
+			});
+	}
+
+	//Accumulates every chunk of [0, count) into its own Result and merges those in chunk order. The builder only reduces
+	//bounds and counts, which merge exactly, so the result does not depend on the chunking.
+	template<typename Result, typename Accumulate, typename Merge>
+	static Result Reduce(ThreadPool* pThreadPool, uint32_t count, Accumulate&& accumulate, Merge&& merge)
+	{
+		const uint32_t chunkCount = GetChunkCount(pThreadPool, count);
+		if (chunkCount == 1)
+		{
+			Result result{};
+			accumulate(result, 0u, count);
+			return result;
+		}
+
+		std::vector<Result> chunkResults(chunkCount);
+		ForEachChunk(pThreadPool, count, [&](uint32_t chunkIndex, uint32_t begin, uint32_t end)
+			{
+				accumulate(chunkResults[chunkIndex], begin, end);
+			});
+
+		for (uint32_t chunkIndex = 1; chunkIndex < chunkCount; ++chunkIndex)
+		{
+			merge(chunkResults[0], chunkResults[chunkIndex]);
+		}
+		return chunkResults[0];
+	}
+
+	struct BVH::SplitBins final
+	{
+		AABB bounds[3][BIN_COUNT]{};
+		uint32_t counts[3][BIN_COUNT]{};
+	};
+
+	struct BVH::SubtreeTask final
+	{
+		uint32_t topNodeIndex{};
+		uint32_t depth{};
+		std::vector<BVHNode> nodes{}; //Depth first like Subdivide stores them, the subtree root first
+	};
+
+	struct BVH::LinearSubtreeTask final
+	{
+		uint32_t node{}; //Internal node of the linear build
+		uint32_t nodeIndex{};
+		uint32_t childrenIndex{}; //Where the children of the subtree root go
+		uint32_t depth{};
+	};
+
+	//A primitive, or the part of it on one side of the spatial splits above, with the bounds of that part
+	struct BVH::SpatialReference final
+	{
+		AABB bounds{};
+		uint32_t primitiveIndex{};
+	};
+
+	struct BVH::SpatialSplit final
+	{
+		int axis{};
+		float position{};
+		AABB leftBounds{};
+		AABB rightBounds{};
+		uint32_t leftCount{};
+		uint32_t rightCount{};
+	};
+
+	void BVH::SetThreadPool(ThreadPool* pThreadPool)
+	{
+		g_pBuildThreadPool = pThreadPool;
+	}
+
+	void BVH::SetDefaultBuildMode(BVHBuildMode buildMode)
+	{
+		g_DefaultBuildMode = buildMode;
+	}
+
+	BVHBuildMode BVH::GetDefaultBuildMode()
+	{
+		return g_DefaultBuildMode;
+	}
+
+	void BVH::Build(const std::vector<AABB>& primitiveBounds)
+	{
+		Clear();
+
+		const uint32_t primitiveCount = static_cast<uint32_t>(primitiveBounds.size());
+		if (primitiveCount == 0)
+			return;
+
+		ThreadPool* pThreadPool = GetBuildThreadPool(primitiveCount);
+
+		m_PrimitiveCount = primitiveCount;
+		m_PrimitiveIndices.resize(primitiveCount);
+		m_Centroids.resize(primitiveCount);
+		ForEachChunk(pThreadPool, primitiveCount, [&](uint32_t, uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					m_PrimitiveIndices[i] = i;
+					m_Centroids[i] = primitiveBounds[i].Center();
+				}
+			});
+
+		if (m_BuildMode == BVHBuildMode::SpatialSplits)
+		{
+			BuildSpatial(primitiveBounds);
+		}
+		else if (m_BuildMode != BVHBuildMode::SAH)
+		{
+			BuildLinear(primitiveBounds, pThreadPool);
+		}
+		else
+		{
+			BVHNode& root = m_Nodes.emplace_back();
+			root.leftFirst = 0;
+			root.primitiveCount = primitiveCount;
+			UpdateNodeBounds(root, primitiveBounds, pThreadPool);
+
+			if (primitiveCount >= STABLE_PARTITION_MIN_PRIMITIVES)
+			{
+				m_PartitionScratch.resize(primitiveCount);
+				m_PartitionSides.resize(primitiveCount);
+			}
+
+			if (pThreadPool)
+			{
+				SubdivideParallel(primitiveBounds, *pThreadPool);
+			}
+			else
+			{
+				//A binary tree over N primitives never needs more than 2N - 1 nodes
+				m_Nodes.reserve(primitiveCount * size_t{ 2 } - 1);
+				Subdivide(m_Nodes, 0, 0, primitiveBounds);
+			}
+		}
+
+		m_Centroids.clear();
+		m_Centroids.shrink_to_fit();
+		m_PartitionScratch.clear();
+		m_PartitionScratch.shrink_to_fit();
+		m_PartitionSides.clear();
+		m_PartitionSides.shrink_to_fit();
+
+		m_BuildCost = CalculateCost();
+		m_IsRefitBaselinePending = m_BuildMode == BVHBuildMode::SpatialSplits;
+		CollapseWideNodes();
+	}
+
+	void BVH::Build(const std::vector<Vector3>& positions, const std::vector<int>& indices)
+	{
+		std::vector<AABB> triangleBounds(indices.size() / 3);
+		ForEachChunk(GetBuildThreadPool(static_cast<uint32_t>(triangleBounds.size())), static_cast<uint32_t>(triangleBounds.size()),
+			[&](uint32_t, uint32_t begin, uint32_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					triangleBounds[i].Grow(positions[indices[i * 3]]);
+					triangleBounds[i].Grow(positions[indices[i * 3 + 1]]);
+					triangleBounds[i].Grow(positions[indices[i * 3 + 2]]);
+				}
+			});
+
+		m_pBuildPositions = &positions;
+		m_pBuildIndices = &indices;
+		Build(triangleBounds);
+		m_pBuildPositions = nullptr;
+		m_pBuildIndices = nullptr;
+	}
+
+	bool BVH::Assign(std::vector<BVHNode> nodes, std::vector<uint32_t> primitiveIndices, uint32_t primitiveCount)
+	{
+		Clear();
+
+		const size_t slotCount = primitiveIndices.size();
+		if (nodes.empty() != (slotCount == 0) || slotCount < primitiveCount)
+			return false;
+
+		//Walk the tree from the root like traversal does: every node has to be reached exactly once within the depth the
+		//traversal stacks are sized for, interior nodes have to enclose their children, and the leaves have to cover
+		//every primitive slot exactly once
+		std::vector<uint8_t> isNodeReached(nodes.size());
+		std::vector<uint8_t> isSlotCovered(slotCount);
+		std::vector<std::pair<uint32_t, uint32_t>> stack{ { 0u, 0u } }; //Node index and depth
+		size_t reachedCount = 0;
+		while (!stack.empty())
+		{
+			const auto [nodeIndex, depth] = stack.back();
+			stack.pop_back();
+			if (isNodeReached[nodeIndex] || depth >= BVH_MAX_DEPTH)
+				return false;
+			isNodeReached[nodeIndex] = 1;
+			++reachedCount;
+
+			const BVHNode& node = nodes[nodeIndex];
+			if (node.IsLeaf())
+			{
+				if (node.leftFirst > slotCount || node.primitiveCount > slotCount - node.leftFirst)
+					return false;
+				for (uint32_t slot = node.leftFirst; slot < node.leftFirst + node.primitiveCount; ++slot)
+				{
+					if (isSlotCovered[slot])
+						return false;
+					isSlotCovered[slot] = 1;
+				}
+				continue;
+			}
+
+			//Children have to follow their parent like Build stores them
+			if (node.leftFirst <= nodeIndex || node.leftFirst + size_t{ 1 } >= nodes.size())
+				return false;
+			//A parent that doesn't enclose its children makes traversal skip geometry, written so NaN bounds fail too
+			if (!ContainsBounds(node, nodes[node.leftFirst]) || !ContainsBounds(node, nodes[node.leftFirst + 1]))
+				return false;
+			stack.push_back({ node.leftFirst, depth + 1 });
+			stack.push_back({ node.leftFirst + 1, depth + 1 });
+		}
+
+		if (reachedCount != nodes.size() || std::find(isSlotCovered.begin(), isSlotCovered.end(), uint8_t{ 0 }) != isSlotCovered.end())
+			return false;
+
+		for (const uint32_t primitiveIndex : primitiveIndices)
+		{
+			if (primitiveIndex >= primitiveCount)
+				return false;
+		}
+
+		m_Nodes = std::move(nodes);
+		m_PrimitiveIndices = std::move(primitiveIndices);
+		m_PrimitiveCount = primitiveCount;
+
+		m_BuildCost = CalculateCost();
+		m_IsRefitBaselinePending = m_BuildMode == BVHBuildMode::SpatialSplits;
+		CollapseWideNodes();
+		return true;
+	}
+
+	void BVH::Clear()
+	{
+		m_Nodes.clear();
+		m_PrimitiveIndices.clear();
+		m_WideNodes4.clear();
+		m_WideNodes8.clear();
+		m_Centroids.clear();
+		m_PrimitiveCount = 0;
+		m_BuildCost = 0.f;
+		m_IsRefitBaselinePending = false;
+	}
+
+	void BVH::Refit(const std::vector<AABB>& primitiveBounds)
+	{
+		RefitNodes([&](uint32_t primitiveIndex)
+			{
+				return primitiveBounds[primitiveIndex];
+			});
+		CollapseWideNodes();
+	}
+
+	void BVH::Refit(const std::vector<Vector3>& positions, const std::vector<int>& indices)
+	{
+		RefitNodes([&](uint32_t primitiveIndex)
+			{
+				const size_t firstIndex = primitiveIndex * size_t{ 3 };
+				AABB bounds{};
+				bounds.Grow(positions[indices[firstIndex]]);
+				bounds.Grow(positions[indices[firstIndex + 1]]);
+				bounds.Grow(positions[indices[firstIndex + 2]]);
+				return bounds;
+			});
+		CollapseWideNodes();
+	}
+
+	void BVH::Update(const std::vector<AABB>& primitiveBounds, float rebuildThreshold)
+	{
+		if (IsEmpty() || GetPrimitiveCount() != primitiveBounds.size())
+		{
+			Build(primitiveBounds);
+			return;
+		}
+
+		if (rebuildThreshold > 0.f)
+		{
+			Refit(primitiveBounds);
+			if (!IsRefitDegraded(rebuildThreshold))
+				return;
+		}
+
+		UseAnimatedBuildMode();
+		Build(primitiveBounds);
+	}
+
+	void BVH::Update(const std::vector<Vector3>& positions, const std::vector<int>& indices, float rebuildThreshold)
+	{
+		if (IsEmpty() || GetPrimitiveCount() != indices.size() / 3)
+		{
+			Build(positions, indices);
+			return;
+		}
+
+		if (rebuildThreshold > 0.f)
+		{
+			Refit(positions, indices);
+			if (!IsRefitDegraded(rebuildThreshold))
+				return;
+		}
+
+		UseAnimatedBuildMode();
+		Build(positions, indices);
+	}
+
+	bool BVH::IsRefitDegraded(float rebuildThreshold)
+	{
+		const float cost = CalculateCost();
+
+		//Spatial split trees are built with clipped bounds a refit can not reproduce, so the cost of their first refit is
+		//the baseline instead of the build cost
+		if (m_IsRefitBaselinePending)
+		{
+			m_BuildCost = cost;
+			m_IsRefitBaselinePending = false;
+			return false;
+		}
+
+		return cost > m_BuildCost * rebuildThreshold;
+	}
+
+	void BVH::UseAnimatedBuildMode()
+	{
+		//Geometry that has to be rebuilt while it moves never gets the slow spatial split build again
+		if (m_BuildMode == BVHBuildMode::SpatialSplits)
+			m_BuildMode = BVHBuildMode::SAH;
+	}
+
+	float BVH::CalculateCost() const
+	{
+		if (IsEmpty())
+			return 0.f;
+
+		const float rootArea = AABB{ m_Nodes[0].minAABB, m_Nodes[0].maxAABB }.Area();
+		if (rootArea <= 0.f)
+			return 0.f;
+
+		//Interior nodes cost one traversal step, leaves one intersection per block, both weighted by hit probability
+		float cost = 0.f;
+		for (const BVHNode& node : m_Nodes)
+		{
+			const float area = AABB{ node.minAABB, node.maxAABB }.Area();
+			cost += area * (node.IsLeaf() ? static_cast<float>(GetBlockCount(node.primitiveCount)) : TRAVERSAL_COST);
+		}
+
+		return cost / rootArea;
+	}
+
+	BVHBuildParameters BVH::GetBuildParameters() const
+	{
+		return BVHBuildParameters{ BUILDER_VERSION, m_BuildMode, m_LeafBlockWidth, static_cast<uint32_t>(BIN_COUNT), MAX_LEAF_SIZE, TRAVERSAL_COST };
+	}
+
+	void BVH::SetLeafBlockWidth(uint32_t width)
+	{
+		if (width == m_LeafBlockWidth)
+			return;
+
+		m_LeafBlockWidth = std::max(width, 1u);
+		Clear();
+	}
+
+	void BVH::SetBuildMode(BVHBuildMode buildMode)
+	{
+		if (buildMode == m_BuildMode)
+			return;
+
+		m_BuildMode = buildMode;
+		Clear();
+	}
+
+	void BVH::SetNodeWidth(uint32_t width)
+	{
+		if (width != 4 && width != 8)
+			width = 2;
+		if (width == m_NodeWidth)
+			return;
+
+		m_NodeWidth = width;
+		CollapseWideNodes();
+	}
+
+	void BVH::CollapseWideNodes()
+	{
+		m_WideNodes4.clear();
+		m_WideNodes8.clear();
+		if (IsEmpty())
+			return;
+
+		//Every wide node replaces at least Width - 1 interior binary nodes
+		switch (m_NodeWidth)
+		{
+		case 8:
+			m_WideNodes8.reserve(m_Nodes.size() / 7 + 1);
+			CollapseNode(0, m_WideNodes8);
+			break;
+		case 4:
+			m_WideNodes4.reserve(m_Nodes.size() / 3 + 1);
+			CollapseNode(0, m_WideNodes4);
+			break;
+		default:
+			break;
+		}
+	}
+
+	template<int Width>
+	uint32_t BVH::CollapseNode(uint32_t nodeIndex, std::vector<WideBVHNode<Width>>& wideNodes) const
+	{
+		const uint32_t wideIndex = static_cast<uint32_t>(wideNodes.size());
+		wideNodes.emplace_back();
+
+		uint32_t children[Width]{};
+		uint32_t childCount = 0;
+		const BVHNode& node = m_Nodes[nodeIndex];
+		if (node.IsLeaf())
+		{
+			children[childCount++] = nodeIndex;
+		}
+		else
+		{
+			children[childCount++] = node.leftFirst;
+			children[childCount++] = node.leftFirst + 1;
+		}
+
+		//Keep opening the largest interior child, it is the one most rays would otherwise descend into
+		while (childCount < Width)
+		{
+			int largestChild = -1;
+			float largestArea = -1.f;
+			for (uint32_t i = 0; i < childCount; ++i)
+			{
+				const BVHNode& child = m_Nodes[children[i]];
+				const float area = AABB{ child.minAABB, child.maxAABB }.Area();
+				if (!child.IsLeaf() && area > largestArea)
+				{
+					largestChild = static_cast<int>(i);
+					largestArea = area;
+				}
+			}
+
+			if (largestChild < 0)
+				break;
+
+			const uint32_t openedIndex = children[largestChild];
+			children[largestChild] = m_Nodes[openedIndex].leftFirst;
+			children[childCount++] = m_Nodes[openedIndex].leftFirst + 1;
+		}
+
+		for (uint32_t i = 0; i < childCount; ++i)
+		{
+			const BVHNode& child = m_Nodes[children[i]];
+			const uint32_t wideChild = child.IsLeaf() ? children[i] | WideBVHNode<Width>::LEAF_FLAG : CollapseNode(children[i], wideNodes);
+
+			//Recursing may have grown the vector, so the node is looked up again
+			WideBVHNode<Width>& wideNode = wideNodes[wideIndex];
+			wideNode.minX[i] = child.minAABB.x;
+			wideNode.minY[i] = child.minAABB.y;
+			wideNode.minZ[i] = child.minAABB.z;
+			wideNode.maxX[i] = child.maxAABB.x;
+			wideNode.maxY[i] = child.maxAABB.y;
+			wideNode.maxZ[i] = child.maxAABB.z;
+			wideNode.children[i] = wideChild;
+		}
+		wideNodes[wideIndex].childCount = childCount;
+
+		return wideIndex;
+	}
+
+	template<typename LeafBounds>
+	void BVH::RefitNodes(LeafBounds&& getPrimitiveBounds)
+	{
+		//Children are always stored after their parent, so a reverse sweep visits them first
+		for (size_t nodeIndex = m_Nodes.size(); nodeIndex-- > 0;)
+		{
+			BVHNode& node = m_Nodes[nodeIndex];
+			if (node.IsLeaf())
+			{
+				AABB bounds{};
+				for (uint32_t i = 0; i < node.primitiveCount; ++i)
+				{
+					bounds.Grow(getPrimitiveBounds(m_PrimitiveIndices[node.leftFirst + i]));
+				}
+				node.minAABB = bounds.min;
+				node.maxAABB = bounds.max;
+				continue;
+			}
+
+			const BVHNode& leftChild = m_Nodes[node.leftFirst];
+			const BVHNode& rightChild = m_Nodes[node.leftFirst + 1];
+			node.minAABB = Vector3::Min(leftChild.minAABB, rightChild.minAABB);
+			node.maxAABB = Vector3::Max(leftChild.maxAABB, rightChild.maxAABB);
+		}
+	}
+
+	void BVH::UpdateNodeBounds(BVHNode& node, const std::vector<AABB>& primitiveBounds, ThreadPool* pThreadPool) const
+	{
+		const uint32_t first = node.leftFirst;
+		const AABB bounds = Reduce<AABB>(pThreadPool, node.primitiveCount,
+			[&](AABB& chunkBounds, uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					chunkBounds.Grow(primitiveBounds[m_PrimitiveIndices[first + i]]);
+				}
+			},
+			[](AABB& result, const AABB& chunkBounds) { result.Grow(chunkBounds); });
+
+		node.minAABB = bounds.min;
+		node.maxAABB = bounds.max;
+	}
+
+	bool BVH::SplitNode(std::vector<BVHNode>& nodes, uint32_t nodeIndex, uint32_t depth, const std::vector<AABB>& primitiveBounds,
+		ThreadPool* pThreadPool)
+	{
+		const BVHNode node = nodes[nodeIndex];
+		if (node.primitiveCount <= 1 || depth + 1 >= BVH_MAX_DEPTH)
+			return false;
+
+		int axis{};
+		float splitPosition{};
+		const float splitCost = FindBestSplit(node, axis, splitPosition, primitiveBounds, pThreadPool);
+
+		const AABB nodeBounds{ node.minAABB, node.maxAABB };
+		const float nodeArea = nodeBounds.Area();
+		const float noSplitCost = GetBlockCount(node.primitiveCount) * nodeArea;
+		if (TRAVERSAL_COST * nodeArea + splitCost >= noSplitCost && node.primitiveCount <= MAX_LEAF_SIZE)
+			return false;
+		if (splitCost == FLT_MAX)
+			return false;
+
+		const uint32_t leftCount = node.primitiveCount >= STABLE_PARTITION_MIN_PRIMITIVES
+			? PartitionStable(node, axis, splitPosition, pThreadPool)
+			: Partition(node, axis, splitPosition);
+		if (leftCount == 0 || leftCount == node.primitiveCount)
+			return false;
+
+		BVHNode leftChild{};
+		leftChild.leftFirst = node.leftFirst;
+		leftChild.primitiveCount = leftCount;
+		UpdateNodeBounds(leftChild, primitiveBounds, pThreadPool);
+
+		BVHNode rightChild{};
+		rightChild.leftFirst = node.leftFirst + leftCount;
+		rightChild.primitiveCount = node.primitiveCount - leftCount;
+		UpdateNodeBounds(rightChild, primitiveBounds, pThreadPool);
+
+		nodes[nodeIndex].leftFirst = static_cast<uint32_t>(nodes.size());
+		nodes[nodeIndex].primitiveCount = 0;
+		nodes.push_back(leftChild);
+		nodes.push_back(rightChild);
+		return true;
+	}
+
+	uint32_t BVH::Partition(const BVHNode& node, int axis, float splitPosition)
+	{
+		//In place, swapping every primitive right of the split plane to the back
+		uint32_t i = node.leftFirst;
+		uint32_t j = i + node.primitiveCount - 1;
+		while (i <= j)
+		{
+			if (m_Centroids[m_PrimitiveIndices[i]][axis] < splitPosition)
+			{
+				++i;
+			}
+			else
+			{
+				std::swap(m_PrimitiveIndices[i], m_PrimitiveIndices[j]);
+				if (j == 0)
+					break;
+				--j;
+			}
+		}
+
+		return i - node.leftFirst;
+	}
+
+	uint32_t BVH::PartitionStable(const BVHNode& node, int axis, float splitPosition, ThreadPool* pThreadPool)
+	{
+		const uint32_t first = node.leftFirst;
+		const uint32_t count = node.primitiveCount;
+		const auto isLeft = [&](uint32_t primitiveIndex) { return m_Centroids[primitiveIndex][axis] < splitPosition; };
+
+		const uint32_t chunkCount = GetChunkCount(pThreadPool, count);
+		std::vector<uint32_t> chunkLeftCounts(chunkCount);
+		ForEachChunk(pThreadPool, count, [&](uint32_t chunkIndex, uint32_t begin, uint32_t end)
+			{
+				uint32_t leftCount = 0;
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					const bool isPrimitiveLeft = isLeft(m_PrimitiveIndices[first + i]);
+					m_PartitionSides[first + i] = isPrimitiveLeft;
+					leftCount += isPrimitiveLeft ? 1 : 0;
+				}
+				chunkLeftCounts[chunkIndex] = leftCount;
+			});
+
+		//Exclusive prefix sum, every chunk learns where its left primitives go
+		std::vector<uint32_t> chunkLeftOffsets(chunkCount);
+		uint32_t leftCount = 0;
+		for (uint32_t chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex)
+		{
+			chunkLeftOffsets[chunkIndex] = leftCount;
+			leftCount += chunkLeftCounts[chunkIndex];
+		}
+
+		//Every chunk scatters into the scratch range of the node, right primitives go after all left ones
+		ForEachChunk(pThreadPool, count, [&](uint32_t chunkIndex, uint32_t begin, uint32_t end)
+			{
+				uint32_t leftPosition = first + chunkLeftOffsets[chunkIndex];
+				uint32_t rightPosition = first + leftCount + begin - chunkLeftOffsets[chunkIndex];
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					m_PartitionScratch[m_PartitionSides[first + i] ? leftPosition++ : rightPosition++] = m_PrimitiveIndices[first + i];
+				}
+			});
+
+		ForEachChunk(pThreadPool, count, [&](uint32_t, uint32_t begin, uint32_t end)
+			{
+				std::copy(m_PartitionScratch.begin() + first + begin, m_PartitionScratch.begin() + first + end,
+					m_PrimitiveIndices.begin() + first + begin);
+			});
+
+		return leftCount;
+	}
+
+	void BVH::Subdivide(std::vector<BVHNode>& nodes, uint32_t nodeIndex, uint32_t depth, const std::vector<AABB>& primitiveBounds)
+	{
+		if (!SplitNode(nodes, nodeIndex, depth, primitiveBounds, nullptr))
+			return;
+
+		const uint32_t leftChildIndex = nodes[nodeIndex].leftFirst;
+		Subdivide(nodes, leftChildIndex, depth + 1, primitiveBounds);
+		Subdivide(nodes, leftChildIndex + 1, depth + 1, primitiveBounds);
+	}
+
+	void BVH::SubdivideParallel(const std::vector<AABB>& primitiveBounds, ThreadPool& threadPool)
+	{
+		//Top of the tree: nodes too big for one task are split one by one, with their binning, partition and bounds spread
+		//over the pool
+		std::vector<BVHNode> topNodes{ m_Nodes[0] };
+		std::vector<SubtreeTask> tasks{};
+		const uint32_t taskSize = std::max(STABLE_PARTITION_MIN_PRIMITIVES, topNodes[0].primitiveCount / (threadPool.GetThreadCount() * 8));
+
+		const auto subdivideTop = [&](const auto& self, uint32_t nodeIndex, uint32_t depth) -> void
+			{
+				if (topNodes[nodeIndex].primitiveCount <= taskSize)
+				{
+					tasks.push_back(SubtreeTask{ nodeIndex, depth });
+					return;
+				}
+
+				if (!SplitNode(topNodes, nodeIndex, depth, primitiveBounds, &threadPool))
+					return;
+
+				const uint32_t leftChildIndex = topNodes[nodeIndex].leftFirst;
+				self(self, leftChildIndex, depth + 1);
+				self(self, leftChildIndex + 1, depth + 1);
+			};
+		subdivideTop(subdivideTop, 0, 0);
+
+		//Below it every subtree is built on its own, partitioning a disjoint range of the primitive indices
+		threadPool.ParallelFor(static_cast<uint32_t>(tasks.size()), [&](uint32_t taskIndex)
+			{
+				SubtreeTask& task = tasks[taskIndex];
+				const BVHNode& root = topNodes[task.topNodeIndex];
+				task.nodes.reserve(root.primitiveCount * size_t{ 2 } - 1);
+				task.nodes.push_back(root);
+				Subdivide(task.nodes, 0, task.depth, primitiveBounds);
+			});
+
+		//Stitch the pieces together in the depth first order Subdivide stores nodes in, so the result is identical to a
+		//single threaded build
+		std::vector<uint32_t> taskOfTopNode(topNodes.size(), UINT32_MAX);
+		size_t nodeCount = topNodes.size();
+		for (uint32_t taskIndex = 0; taskIndex < tasks.size(); ++taskIndex)
+		{
+			taskOfTopNode[tasks[taskIndex].topNodeIndex] = taskIndex;
+			nodeCount += tasks[taskIndex].nodes.size() - 1;
+		}
+
+		m_Nodes.clear();
+		m_Nodes.reserve(nodeCount);
+		m_Nodes.emplace_back();
+
+		const auto emitNode = [&](const auto& self, uint32_t topNodeIndex, uint32_t nodeIndex) -> void
+			{
+				const BVHNode& topNode = topNodes[topNodeIndex];
+				if (taskOfTopNode[topNodeIndex] != UINT32_MAX)
+				{
+					//Subtree nodes after its root move by the same offset
+					const std::vector<BVHNode>& subtreeNodes = tasks[taskOfTopNode[topNodeIndex]].nodes;
+					const uint32_t offset = static_cast<uint32_t>(m_Nodes.size()) - 1;
+					for (size_t i = 0; i < subtreeNodes.size(); ++i)
+					{
+						BVHNode node = subtreeNodes[i];
+						if (!node.IsLeaf())
+							node.leftFirst += offset;
+
+						if (i == 0)
+							m_Nodes[nodeIndex] = node;
+						else
+							m_Nodes.push_back(node);
+					}
+					return;
+				}
+
+				m_Nodes[nodeIndex] = topNode;
+				if (topNode.IsLeaf())
+					return;
+
+				const uint32_t leftChildIndex = static_cast<uint32_t>(m_Nodes.size());
+				m_Nodes[nodeIndex].leftFirst = leftChildIndex;
+				m_Nodes.emplace_back();
+				m_Nodes.emplace_back();
+				self(self, topNode.leftFirst, leftChildIndex);
+				self(self, topNode.leftFirst + 1, leftChildIndex + 1);
+			};
+		emitNode(emitNode, 0, 0);
+	}
+
+	float BVH::FindBestSplit(const BVHNode& node, int& axis, float& splitPosition, const std::vector<AABB>& primitiveBounds,
+		ThreadPool* pThreadPool) const
+	{
+		const uint32_t first = node.leftFirst;
+
+		//Bins are laid out over the centroid bounds, not the node bounds, so large primitives do not waste bins
+		const AABB centroidBounds = Reduce<AABB>(pThreadPool, node.primitiveCount,
+			[&](AABB& chunkBounds, uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					chunkBounds.Grow(m_Centroids[m_PrimitiveIndices[first + i]]);
+				}
+			},
+			[](AABB& result, const AABB& chunkBounds) { result.Grow(chunkBounds); });
+
+		float boundsMin[3]{};
+		float scales[3]{};
+		bool isSplittable[3]{};
+		for (int currentAxis = 0; currentAxis < 3; ++currentAxis)
+		{
+			boundsMin[currentAxis] = centroidBounds.min[currentAxis];
+			isSplittable[currentAxis] = centroidBounds.min[currentAxis] != centroidBounds.max[currentAxis];
+			if (isSplittable[currentAxis])
+				scales[currentAxis] = BIN_COUNT / (centroidBounds.max[currentAxis] - centroidBounds.min[currentAxis]);
+		}
+
+		//All three axes are binned in one pass over the primitives
+		const SplitBins bins = Reduce<SplitBins>(pThreadPool, node.primitiveCount,
+			[&](SplitBins& chunkBins, uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					const uint32_t primitiveIndex = m_PrimitiveIndices[first + i];
+					const Vector3& centroid = m_Centroids[primitiveIndex];
+					for (int currentAxis = 0; currentAxis < 3; ++currentAxis)
+					{
+						if (!isSplittable[currentAxis])
+							continue;
+
+						const int binIndex = std::min(BIN_COUNT - 1,
+							static_cast<int>((centroid[currentAxis] - boundsMin[currentAxis]) * scales[currentAxis]));
+						chunkBins.bounds[currentAxis][binIndex].Grow(primitiveBounds[primitiveIndex]);
+						++chunkBins.counts[currentAxis][binIndex];
+					}
+				}
+			},
+			[](SplitBins& result, const SplitBins& chunkBins)
+			{
+				for (int currentAxis = 0; currentAxis < 3; ++currentAxis)
+				{
+					for (int binIndex = 0; binIndex < BIN_COUNT; ++binIndex)
+					{
+						result.bounds[currentAxis][binIndex].Grow(chunkBins.bounds[currentAxis][binIndex]);
+						result.counts[currentAxis][binIndex] += chunkBins.counts[currentAxis][binIndex];
+					}
+				}
+			});
+
+		float bestCost = FLT_MAX;
+		for (int currentAxis = 0; currentAxis < 3; ++currentAxis)
+		{
+			if (!isSplittable[currentAxis])
+				continue;
+
+			const AABB* binBounds = bins.bounds[currentAxis];
+			const uint32_t* binCounts = bins.counts[currentAxis];
+
+			//Sweep from both sides to get the area and count left and right of every bin boundary
+			float leftAreas[BIN_COUNT - 1]{};
+			float rightAreas[BIN_COUNT - 1]{};
+			uint32_t leftCounts[BIN_COUNT - 1]{};
+			uint32_t rightCounts[BIN_COUNT - 1]{};
+
+			AABB leftBounds{};
+			AABB rightBounds{};
+			uint32_t leftSum = 0;
+			uint32_t rightSum = 0;
+			for (int i = 0; i < BIN_COUNT - 1; ++i)
+			{
+				leftSum += binCounts[i];
+				leftCounts[i] = leftSum;
+				leftBounds.Grow(binBounds[i]);
+				leftAreas[i] = leftBounds.Area();
+
+				rightSum += binCounts[BIN_COUNT - 1 - i];
+				rightCounts[BIN_COUNT - 2 - i] = rightSum;
+				rightBounds.Grow(binBounds[BIN_COUNT - 1 - i]);
+				rightAreas[BIN_COUNT - 2 - i] = rightBounds.Area();
+			}
+
+			const float boundsMax = centroidBounds.max[currentAxis];
+			const float binWidth = (boundsMax - boundsMin[currentAxis]) / BIN_COUNT;
+			for (int i = 0; i < BIN_COUNT - 1; ++i)
+			{
+				if (leftCounts[i] == 0 || rightCounts[i] == 0)
+					continue;
+
+				const float cost = GetBlockCount(leftCounts[i]) * leftAreas[i] + GetBlockCount(rightCounts[i]) * rightAreas[i];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					axis = currentAxis;
+					splitPosition = boundsMin[currentAxis] + binWidth * (i + 1);
+				}
+			}
+		}
+
+		return bestCost;
+	}
+
+	//Spreads the low 10 bits of value out to every third bit
+	static uint32_t ExpandMortonBits(uint32_t value)
+	{
+		value &= 0x3FFu;
+		value = (value | (value << 16)) & 0x030000FFu;
+		value = (value | (value << 8)) & 0x0300F00Fu;
+		value = (value | (value << 4)) & 0x030C30C3u;
+		value = (value | (value << 2)) & 0x09249249u;
+		return value;
+	}
+
+	//Spreads the low 21 bits of value out to every third bit
+	static uint64_t ExpandMortonBits(uint64_t value)
+	{
+		value &= 0x1FFFFFull;
+		value = (value | (value << 32)) & 0x001F00000000FFFFull;
+		value = (value | (value << 16)) & 0x001F0000FF0000FFull;
+		value = (value | (value << 8)) & 0x100F00F00F00F00Full;
+		value = (value | (value << 4)) & 0x10C30C30C30C30C3ull;
+		value = (value | (value << 2)) & 0x1249249249249249ull;
+		return value;
+	}
+
+	//Least significant digit first radix sort of the codes, moving the values along. Every chunk counts its digits, the
+	//counts are turned into per chunk bucket offsets and every chunk scatters its own elements, which keeps every pass
+	//stable and the result independent of the chunking.
+	template<typename MortonCode>
+	static void RadixSort(std::vector<MortonCode>& codes, std::vector<uint32_t>& values, uint32_t bitCount, ThreadPool* pThreadPool)
+	{
+		static constexpr uint32_t DIGIT_BITS = 11;
+		static constexpr uint32_t BUCKET_COUNT = 1 << DIGIT_BITS;
+
+		const uint32_t count = static_cast<uint32_t>(codes.size());
+		const uint32_t chunkCount = GetChunkCount(pThreadPool, count);
+		std::vector<MortonCode> sortedCodes(count);
+		std::vector<uint32_t> sortedValues(count);
+		std::vector<uint32_t> bucketOffsets(size_t{ chunkCount } * BUCKET_COUNT);
+
+		for (uint32_t shift = 0; shift < bitCount; shift += DIGIT_BITS)
+		{
+			ForEachChunk(pThreadPool, count, [&](uint32_t chunkIndex, uint32_t begin, uint32_t end)
+				{
+					uint32_t* pCounts = &bucketOffsets[size_t{ chunkIndex } * BUCKET_COUNT];
+					std::fill(pCounts, pCounts + BUCKET_COUNT, 0u);
+					for (uint32_t i = begin; i < end; ++i)
+					{
+						++pCounts[(codes[i] >> shift) & (BUCKET_COUNT - 1)];
+					}
+				});
+
+			//Bucket major, chunk minor, so every chunk writes its own slice of every bucket in order
+			uint32_t offset = 0;
+			for (uint32_t bucket = 0; bucket < BUCKET_COUNT; ++bucket)
+			{
+				for (uint32_t chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex)
+				{
+					uint32_t& bucketOffset = bucketOffsets[size_t{ chunkIndex } * BUCKET_COUNT + bucket];
+					const uint32_t bucketCount = bucketOffset;
+					bucketOffset = offset;
+					offset += bucketCount;
+				}
+			}
+
+			ForEachChunk(pThreadPool, count, [&](uint32_t chunkIndex, uint32_t begin, uint32_t end)
+				{
+					uint32_t* pOffsets = &bucketOffsets[size_t{ chunkIndex } * BUCKET_COUNT];
+					for (uint32_t i = begin; i < end; ++i)
+					{
+						const uint32_t position = pOffsets[(codes[i] >> shift) & (BUCKET_COUNT - 1)]++;
+						sortedCodes[position] = codes[i];
+						sortedValues[position] = values[i];
+					}
+				});
+
+			codes.swap(sortedCodes);
+			values.swap(sortedValues);
+		}
+	}
+
+	//Common prefix length of the sorted codes at i and j. Equal codes are told apart by their position, so every key is
+	//unique and both linear emitters produce the same tree.
+	template<typename MortonCode>
+	static int GetMortonPrefix(const std::vector<MortonCode>& codes, uint32_t i, uint32_t j)
+	{
+		const MortonCode difference = codes[i] ^ codes[j];
+		if (difference != 0)
+			return std::countl_zero(difference);
+		return static_cast<int>(sizeof(MortonCode) * 8) + std::countl_zero(i ^ j);
+	}
+
+	//Last index of the left half of the sorted codes [first, last]: the highest bit that differs inside the range is
+	//the coarsest spatial split, found with a binary search for the last key still matching the first one above it
+	template<typename MortonCode>
+	static uint32_t FindMortonSplit(const std::vector<MortonCode>& codes, uint32_t first, uint32_t last)
+	{
+		const int commonPrefix = GetMortonPrefix(codes, first, last);
+
+		uint32_t split = first;
+		uint32_t step = last - first;
+		do
+		{
+			step = (step + 1) / 2;
+			const uint32_t candidate = split + step;
+			if (candidate < last && GetMortonPrefix(codes, first, candidate) > commonPrefix)
+				split = candidate;
+		} while (step > 1);
+
+		return split;
+	}
+
+	void BVH::BuildLinear(const std::vector<AABB>& primitiveBounds, ThreadPool* pThreadPool)
+	{
+		if (GetPrimitiveCount() > LINEAR_SHORT_CODE_MAX_PRIMITIVES)
+			BuildLinear<uint64_t>(primitiveBounds, pThreadPool);
+		else
+			BuildLinear<uint32_t>(primitiveBounds, pThreadPool);
+
+		if (m_BuildMode == BVHBuildMode::LinearTreelets)
+			OptimizeTreelets();
+	}
+
+	template<typename MortonCode>
+	void BVH::BuildLinear(const std::vector<AABB>& primitiveBounds, ThreadPool* pThreadPool)
+	{
+		static constexpr uint32_t BITS_PER_AXIS = sizeof(MortonCode) == sizeof(uint32_t) ? 10 : 21;
+		static constexpr uint32_t MAX_CELL = (1u << BITS_PER_AXIS) - 1;
+
+		const uint32_t primitiveCount = GetPrimitiveCount();
+
+		//Codes quantize the centroids inside cubic cells, so flat geometry does not spend its top splits on the thin axis
+		const AABB centroidBounds = Reduce<AABB>(pThreadPool, primitiveCount,
+			[&](AABB& chunkBounds, uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					chunkBounds.Grow(m_Centroids[i]);
+				}
+			},
+			[](AABB& result, const AABB& chunkBounds) { result.Grow(chunkBounds); });
+
+		const Vector3 extent = centroidBounds.max - centroidBounds.min;
+		const float maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+		const float scale = maxExtent > 0.f ? (MAX_CELL + 1) / maxExtent : 0.f;
+
+		std::vector<MortonCode> codes(primitiveCount);
+		ForEachChunk(pThreadPool, primitiveCount, [&](uint32_t, uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					MortonCode code = 0;
+					for (int axis = 0; axis < 3; ++axis)
+					{
+						const uint32_t cell = std::min(MAX_CELL, static_cast<uint32_t>((m_Centroids[i][axis] - centroidBounds.min[axis]) * scale));
+						code |= ExpandMortonBits(static_cast<MortonCode>(cell)) << (2 - axis);
+					}
+					codes[i] = code;
+				}
+			});
+
+		RadixSort(codes, m_PrimitiveIndices, BITS_PER_AXIS * 3, pThreadPool);
+
+		const uint32_t leafSize = std::max(m_LeafBlockWidth, LINEAR_MIN_LEAF_SIZE);
+		if (EmitLinearHierarchy(codes, primitiveBounds, leafSize, pThreadPool))
+			return;
+
+		//Codes clustered deeper than the traversal stacks allow, split top-down at the same Morton boundaries instead,
+		//which stops at the depth limit
+		m_Nodes.clear();
+		m_Nodes.reserve(primitiveCount / leafSize * size_t{ 4 } + 1);
+		m_Nodes.push_back(BVHNode{ {}, 0, {}, primitiveCount });
+
+		const auto splitNode = [&](const auto& self, uint32_t nodeIndex, uint32_t depth) -> void
+			{
+				const uint32_t first = m_Nodes[nodeIndex].leftFirst;
+				const uint32_t count = m_Nodes[nodeIndex].primitiveCount;
+				if (count <= leafSize || depth + 1 >= BVH_MAX_DEPTH)
+					return;
+
+				const uint32_t leftCount = FindMortonSplit(codes, first, first + count - 1) - first + 1;
+				const uint32_t leftChildIndex = static_cast<uint32_t>(m_Nodes.size());
+				m_Nodes.push_back(BVHNode{ {}, first, {}, leftCount });
+				m_Nodes.push_back(BVHNode{ {}, first + leftCount, {}, count - leftCount });
+				m_Nodes[nodeIndex].leftFirst = leftChildIndex;
+				m_Nodes[nodeIndex].primitiveCount = 0;
+
+				self(self, leftChildIndex, depth + 1);
+				self(self, leftChildIndex + 1, depth + 1);
+			};
+		splitNode(splitNode, 0, 0);
+
+		RefitNodes([&](uint32_t primitiveIndex)
+			{
+				return primitiveBounds[primitiveIndex];
+			});
+	}
+
+	template<typename MortonCode>
+	bool BVH::EmitLinearHierarchy(const std::vector<MortonCode>& codes, const std::vector<AABB>& primitiveBounds, uint32_t leafSize,
+		ThreadPool* pThreadPool)
+	{
+		const uint32_t primitiveCount = GetPrimitiveCount();
+		m_Nodes.clear();
+		if (primitiveCount <= leafSize)
+		{
+			AABB rootBounds{};
+			for (const uint32_t primitiveIndex : m_PrimitiveIndices)
+			{
+				rootBounds.Grow(primitiveBounds[primitiveIndex]);
+			}
+			m_Nodes.push_back(BVHNode{ rootBounds.min, 0, rootBounds.max, primitiveCount });
+			return true;
+		}
+
+		//Internal node i splits the sorted primitives between i and i + 1, children with this bit set are single primitives
+		static constexpr uint32_t PRIMITIVE_CHILD = 0x80000000u;
+		const uint32_t internalCount = primitiveCount - 1;
+		std::vector<uint32_t> children(internalCount * size_t{ 2 }); //Left and right
+		std::vector<uint32_t> ranges(internalCount * size_t{ 2 }); //First and last sorted primitive
+		std::vector<AABB> bounds(internalCount);
+		std::vector<uint32_t> subtreeSizes(internalCount); //Nodes once ranges of up to leafSize primitives became leaves
+		std::vector<std::atomic<uint32_t>> arrivals(internalCount);
+		uint32_t rootNode = 0;
+
+		const auto getRange = [&](uint32_t child, uint32_t& first, uint32_t& count)
+			{
+				if (child & PRIMITIVE_CHILD)
+				{
+					first = child & ~PRIMITIVE_CHILD;
+					count = 1;
+					return;
+				}
+				first = ranges[child * size_t{ 2 }];
+				count = ranges[child * size_t{ 2 } + 1] - first + 1;
+			};
+		const auto getBounds = [&](uint32_t child) -> const AABB&
+			{
+				return child & PRIMITIVE_CHILD ? primitiveBounds[m_PrimitiveIndices[child & ~PRIMITIVE_CHILD]] : bounds[child];
+			};
+		const auto getSubtreeSize = [&](uint32_t child)
+			{
+				uint32_t first{};
+				uint32_t count{};
+				getRange(child, first, count);
+				return count <= leafSize ? 1 : subtreeSizes[child];
+			};
+
+		//Bottom-up in linear time: every primitive climbs towards the root and its range joins the neighbour it shares the
+		//longer prefix with. Of the two children of a node the first to arrive stops, the second finishes the node.
+		ForEachChunk(pThreadPool, primitiveCount, [&](uint32_t, uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					uint32_t first = i;
+					uint32_t last = i;
+					uint32_t child = i | PRIMITIVE_CHILD;
+					while (true)
+					{
+						const bool isLeftChild = first == 0
+							|| (last != internalCount && GetMortonPrefix(codes, last, last + 1) > GetMortonPrefix(codes, first - 1, first));
+						const uint32_t node = isLeftChild ? last : first - 1;
+						const size_t side = node * size_t{ 2 } + (isLeftChild ? 0 : 1);
+						children[side] = child;
+						ranges[side] = isLeftChild ? first : last;
+						if (arrivals[node].fetch_add(1, std::memory_order_acq_rel) == 0)
+							break;
+
+						const uint32_t leftChild = children[node * size_t{ 2 }];
+						const uint32_t rightChild = children[node * size_t{ 2 } + 1];
+						bounds[node] = getBounds(leftChild);
+						bounds[node].Grow(getBounds(rightChild));
+						subtreeSizes[node] = 1 + getSubtreeSize(leftChild) + getSubtreeSize(rightChild);
+
+						first = ranges[node * size_t{ 2 }];
+						last = ranges[node * size_t{ 2 } + 1];
+						child = node;
+						if (first == 0 && last == internalCount)
+						{
+							rootNode = node;
+							break;
+						}
+					}
+				}
+			});
+
+		//Top-down into the depth first layout Subdivide produces. Subtree sizes fix where every subtree goes, so subtrees
+		//below the top are stored as independent tasks.
+		m_Nodes.resize(subtreeSizes[rootNode]);
+		std::atomic<bool> isTooDeep{};
+		const uint32_t taskSize = pThreadPool ? std::max(STABLE_PARTITION_MIN_PRIMITIVES, primitiveCount / (pThreadPool->GetThreadCount() * 8)) : UINT32_MAX;
+		std::vector<LinearSubtreeTask> tasks{};
+
+		const auto storeNode = [&](const auto& self, uint32_t child, uint32_t nodeIndex, uint32_t childrenIndex, uint32_t depth,
+			std::vector<LinearSubtreeTask>* pTasks) -> void
+			{
+				uint32_t first{};
+				uint32_t count{};
+				getRange(child, first, count);
+				if (pTasks && count <= taskSize)
+				{
+					pTasks->push_back(LinearSubtreeTask{ child, nodeIndex, childrenIndex, depth });
+					return;
+				}
+
+				const AABB& nodeBounds = getBounds(child);
+				if (count <= leafSize)
+				{
+					m_Nodes[nodeIndex] = BVHNode{ nodeBounds.min, first, nodeBounds.max, count };
+					return;
+				}
+				if (depth + 1 >= BVH_MAX_DEPTH)
+				{
+					isTooDeep.store(true, std::memory_order_relaxed);
+					return;
+				}
+
+				m_Nodes[nodeIndex] = BVHNode{ nodeBounds.min, childrenIndex, nodeBounds.max, 0 };
+				const uint32_t leftChild = children[child * size_t{ 2 }];
+				const uint32_t rightChild = children[child * size_t{ 2 } + 1];
+				self(self, leftChild, childrenIndex, childrenIndex + 2, depth + 1, pTasks);
+				self(self, rightChild, childrenIndex + 1, childrenIndex + 1 + getSubtreeSize(leftChild), depth + 1, pTasks);
+			};
+
+		if (pThreadPool)
+		{
+			storeNode(storeNode, rootNode, 0, 1, 0, &tasks);
+			pThreadPool->ParallelFor(static_cast<uint32_t>(tasks.size()), [&](uint32_t taskIndex)
+				{
+					const LinearSubtreeTask& task = tasks[taskIndex];
+					storeNode(storeNode, task.node, task.nodeIndex, task.childrenIndex, task.depth, nullptr);
+				});
+		}
+		else
+		{
+			storeNode(storeNode, rootNode, 0, 1, 0, nullptr);
+		}
+
+		return !isTooDeep.load(std::memory_order_relaxed);
+	}
+
+	void BVH::OptimizeTreelets()
+	{
+		const uint32_t nodeCount = static_cast<uint32_t>(m_Nodes.size());
+		if (nodeCount < 3)
+			return;
+
+		//Explicit children while the treelets are rearranged, the depth first layout is restored at the end
+		std::vector<uint32_t> leftChildren(nodeCount);
+		std::vector<uint32_t> rightChildren(nodeCount);
+		std::vector<uint32_t> depths(nodeCount);
+		std::vector<uint32_t> heights(nodeCount, 1);
+		std::vector<float> costs(nodeCount);
+		for (uint32_t nodeIndex = 0; nodeIndex < nodeCount; ++nodeIndex)
+		{
+			const BVHNode& node = m_Nodes[nodeIndex];
+			if (node.IsLeaf())
+				continue;
+
+			leftChildren[nodeIndex] = node.leftFirst;
+			rightChildren[nodeIndex] = node.leftFirst + 1;
+			depths[node.leftFirst] = depths[nodeIndex] + 1;
+			depths[node.leftFirst + 1] = depths[nodeIndex] + 1;
+		}
+
+		const auto getArea = [&](uint32_t nodeIndex) { return AABB{ m_Nodes[nodeIndex].minAABB, m_Nodes[nodeIndex].maxAABB }.Area(); };
+
+		//Children are stored after their parent, so a reverse sweep finishes every subtree before its root. Restructuring
+		//only reuses nodes inside the treelet, which all come after its root as well.
+		for (uint32_t nodeIndex = nodeCount; nodeIndex-- > 0;)
+		{
+			const BVHNode& node = m_Nodes[nodeIndex];
+			if (node.IsLeaf())
+			{
+				costs[nodeIndex] = GetBlockCount(node.primitiveCount) * getArea(nodeIndex);
+				continue;
+			}
+
+			const uint32_t leftChild = leftChildren[nodeIndex];
+			const uint32_t rightChild = rightChildren[nodeIndex];
+			costs[nodeIndex] = TRAVERSAL_COST * getArea(nodeIndex) + costs[leftChild] + costs[rightChild];
+			heights[nodeIndex] = 1 + std::max(heights[leftChild], heights[rightChild]);
+
+			//Grow the treelet by opening its largest interior subtree until it has TREELET_SIZE subtrees
+			uint32_t subtrees[TREELET_SIZE]{ leftChild, rightChild };
+			uint32_t subtreeCount = 2;
+			uint32_t interiorNodes[TREELET_SIZE - 1]{ nodeIndex };
+			uint32_t interiorCount = 1;
+			while (subtreeCount < TREELET_SIZE)
+			{
+				int largestSubtree = -1;
+				float largestArea = -1.f;
+				for (uint32_t i = 0; i < subtreeCount; ++i)
+				{
+					if (!m_Nodes[subtrees[i]].IsLeaf() && getArea(subtrees[i]) > largestArea)
+					{
+						largestSubtree = static_cast<int>(i);
+						largestArea = getArea(subtrees[i]);
+					}
+				}
+				if (largestSubtree < 0)
+					break;
+
+				const uint32_t openedNode = subtrees[largestSubtree];
+				interiorNodes[interiorCount++] = openedNode;
+				subtrees[largestSubtree] = leftChildren[openedNode];
+				subtrees[subtreeCount++] = rightChildren[openedNode];
+			}
+
+			if (subtreeCount < 3)
+				continue;
+
+			//Lowest cost binary tree over every subset of the subtrees, smaller subsets first
+			static constexpr uint32_t SUBSET_COUNT = 1 << TREELET_SIZE;
+			AABB subsetBounds[SUBSET_COUNT]{};
+			float subsetCosts[SUBSET_COUNT]{};
+			uint32_t subsetHeights[SUBSET_COUNT]{};
+			uint32_t subsetSplits[SUBSET_COUNT]{};
+
+			const uint32_t fullSet = (1u << subtreeCount) - 1;
+			for (uint32_t subset = 1; subset <= fullSet; ++subset)
+			{
+				const uint32_t lowestBit = subset & (~subset + 1);
+				const uint32_t subtree = subtrees[std::countr_zero(lowestBit)];
+				if (subset == lowestBit)
+				{
+					subsetBounds[subset] = AABB{ m_Nodes[subtree].minAABB, m_Nodes[subtree].maxAABB };
+					subsetCosts[subset] = costs[subtree];
+					subsetHeights[subset] = heights[subtree];
+					continue;
+				}
+
+				subsetBounds[subset] = subsetBounds[subset ^ lowestBit];
+				subsetBounds[subset].Grow(subsetBounds[lowestBit]);
+
+				//Every split keeps the lowest subtree on the left, so each pair of halves is tried once
+				float bestCost = FLT_MAX;
+				for (uint32_t left = (subset - 1) & subset; left != 0; left = (left - 1) & subset)
+				{
+					if (!(left & lowestBit))
+						continue;
+
+					const float cost = subsetCosts[left] + subsetCosts[subset ^ left];
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						subsetSplits[subset] = left;
+					}
+				}
+
+				const uint32_t left = subsetSplits[subset];
+				subsetCosts[subset] = TRAVERSAL_COST * subsetBounds[subset].Area() + bestCost;
+				subsetHeights[subset] = 1 + std::max(subsetHeights[left], subsetHeights[subset ^ left]);
+			}
+
+			//Only restructure for a clear gain, and never beyond the depth traversal stacks are sized for
+			if (subsetCosts[fullSet] >= costs[nodeIndex] * 0.999f || depths[nodeIndex] + subsetHeights[fullSet] > BVH_MAX_DEPTH)
+				continue;
+
+			uint32_t nextInteriorNode = 1;
+			const auto rebuild = [&](const auto& self, uint32_t subset, uint32_t targetNode) -> void
+				{
+					const uint32_t halves[2] = { subsetSplits[subset], subset ^ subsetSplits[subset] };
+					uint32_t children[2]{};
+					for (int side = 0; side < 2; ++side)
+					{
+						if (std::has_single_bit(halves[side]))
+						{
+							children[side] = subtrees[std::countr_zero(halves[side])];
+						}
+						else
+						{
+							children[side] = interiorNodes[nextInteriorNode++];
+							self(self, halves[side], children[side]);
+						}
+					}
+
+					leftChildren[targetNode] = children[0];
+					rightChildren[targetNode] = children[1];
+					m_Nodes[targetNode].minAABB = subsetBounds[subset].min;
+					m_Nodes[targetNode].maxAABB = subsetBounds[subset].max;
+					costs[targetNode] = subsetCosts[subset];
+					heights[targetNode] = subsetHeights[subset];
+				};
+			rebuild(rebuild, fullSet, nodeIndex);
+		}
+
+		//Store the result depth first with sibling pairs again
+		std::vector<BVHNode> nodes{};
+		nodes.reserve(nodeCount);
+		nodes.push_back(m_Nodes[0]);
+
+		const auto storeNode = [&](const auto& self, uint32_t oldIndex, uint32_t newIndex) -> void
+			{
+				if (m_Nodes[oldIndex].IsLeaf())
+				{
+					nodes[newIndex] = m_Nodes[oldIndex];
+					return;
+				}
+
+				const uint32_t leftChildIndex = static_cast<uint32_t>(nodes.size());
+				nodes[newIndex] = m_Nodes[oldIndex];
+				nodes[newIndex].leftFirst = leftChildIndex;
+				nodes.emplace_back();
+				nodes.emplace_back();
+				self(self, leftChildren[oldIndex], leftChildIndex);
+				self(self, rightChildren[oldIndex], leftChildIndex + 1);
+			};
+		storeNode(storeNode, 0, 0);
+
+		m_Nodes = std::move(nodes);
+	}
+
+	void BVH::BuildSpatial(const std::vector<AABB>& primitiveBounds)
+	{
+		const uint32_t primitiveCount = GetPrimitiveCount();
+
+		std::vector<SpatialReference> references(primitiveCount);
+		AABB rootBounds{};
+		for (uint32_t i = 0; i < primitiveCount; ++i)
+		{
+			references[i] = SpatialReference{ primitiveBounds[i], i };
+			rootBounds.Grow(primitiveBounds[i]);
+		}
+
+		m_SpatialSplitBudget = static_cast<uint32_t>(primitiveCount * SPATIAL_SPLIT_MAX_GROWTH);
+		m_PrimitiveIndices.clear();
+		m_PrimitiveIndices.reserve(size_t{ primitiveCount } + m_SpatialSplitBudget);
+		m_Nodes.push_back(BVHNode{ rootBounds.min, 0, rootBounds.max, primitiveCount });
+
+		SubdivideSpatial(0, 0, references, rootBounds.Area());
+	}
+
+	void BVH::SubdivideSpatial(uint32_t nodeIndex, uint32_t depth, std::vector<SpatialReference>& references, float rootArea)
+	{
+		const uint32_t count = static_cast<uint32_t>(references.size());
+		const auto makeLeaf = [&]()
+			{
+				m_Nodes[nodeIndex].leftFirst = static_cast<uint32_t>(m_PrimitiveIndices.size());
+				m_Nodes[nodeIndex].primitiveCount = count;
+				for (const SpatialReference& reference : references)
+				{
+					m_PrimitiveIndices.push_back(reference.primitiveIndex);
+				}
+			};
+
+		if (count <= 1 || depth + 1 >= BVH_MAX_DEPTH)
+		{
+			makeLeaf();
+			return;
+		}
+
+		const AABB nodeBounds{ m_Nodes[nodeIndex].minAABB, m_Nodes[nodeIndex].maxAABB };
+
+		SpatialSplit objectSplit{};
+		const float objectCost = FindObjectSplit(references, objectSplit);
+
+		//Spatial splits only pay off where the object split children overlap noticeably, elsewhere skip their binning
+		SpatialSplit spatialSplit{};
+		float spatialCost = FLT_MAX;
+		const AABB overlap{ Vector3::Max(objectSplit.leftBounds.min, objectSplit.rightBounds.min),
+			Vector3::Min(objectSplit.leftBounds.max, objectSplit.rightBounds.max) };
+		if (objectCost == FLT_MAX || overlap.Area() > SPATIAL_SPLIT_MIN_OVERLAP * rootArea)
+			spatialCost = FindSpatialSplit(references, nodeBounds, spatialSplit);
+
+		const float splitCost = std::min(objectCost, spatialCost);
+		const float nodeArea = nodeBounds.Area();
+		const float noSplitCost = GetBlockCount(count) * nodeArea;
+		if ((TRAVERSAL_COST * nodeArea + splitCost >= noSplitCost && count <= MAX_LEAF_SIZE) || splitCost == FLT_MAX)
+		{
+			makeLeaf();
+			return;
+		}
+
+		std::vector<SpatialReference> leftReferences{};
+		std::vector<SpatialReference> rightReferences{};
+		if (spatialCost < objectCost)
+		{
+			//References crossing the plane are split, unless moving them whole to one side is cheaper
+			const int axis = spatialSplit.axis;
+			const float plane = spatialSplit.position;
+			AABB leftBounds = spatialSplit.leftBounds;
+			AABB rightBounds = spatialSplit.rightBounds;
+			uint32_t leftCount = spatialSplit.leftCount;
+			uint32_t rightCount = spatialSplit.rightCount;
+			const uint32_t budget = m_SpatialSplitBudget;
+
+			for (const SpatialReference& reference : references)
+			{
+				if (reference.bounds.max[axis] <= plane)
+				{
+					leftReferences.push_back(reference);
+					continue;
+				}
+				if (reference.bounds.min[axis] >= plane)
+				{
+					rightReferences.push_back(reference);
+					continue;
+				}
+
+				AABB unsplitLeftBounds = leftBounds;
+				unsplitLeftBounds.Grow(reference.bounds);
+				AABB unsplitRightBounds = rightBounds;
+				unsplitRightBounds.Grow(reference.bounds);
+
+				const float splitReferenceCost = GetBlockCount(leftCount) * leftBounds.Area() + GetBlockCount(rightCount) * rightBounds.Area();
+				const float leftOnlyCost = GetBlockCount(leftCount) * unsplitLeftBounds.Area()
+					+ GetBlockCount(std::max(rightCount, 1u) - 1) * rightBounds.Area();
+				const float rightOnlyCost = GetBlockCount(std::max(leftCount, 1u) - 1) * leftBounds.Area()
+					+ GetBlockCount(rightCount) * unsplitRightBounds.Area();
+
+				const bool canSplit = m_SpatialSplitBudget > 0;
+				if (canSplit && splitReferenceCost <= leftOnlyCost && splitReferenceCost <= rightOnlyCost)
+				{
+					SpatialReference leftReference{};
+					SpatialReference rightReference{};
+					ClipReference(reference, axis, plane, leftReference, rightReference);
+					//Rounding can leave nothing of a barely crossing triangle on one side
+					if (leftReference.bounds.min.x <= leftReference.bounds.max.x)
+						leftReferences.push_back(leftReference);
+					if (rightReference.bounds.min.x <= rightReference.bounds.max.x)
+						rightReferences.push_back(rightReference);
+					--m_SpatialSplitBudget;
+				}
+				else if (leftOnlyCost <= rightOnlyCost)
+				{
+					leftReferences.push_back(reference);
+					leftBounds = unsplitLeftBounds;
+					rightCount = std::max(rightCount, 1u) - 1;
+				}
+				else
+				{
+					rightReferences.push_back(reference);
+					rightBounds = unsplitRightBounds;
+					leftCount = std::max(leftCount, 1u) - 1;
+				}
+			}
+
+			//Unsplitting can empty a side, the object split is used instead then
+			if (leftReferences.empty() || rightReferences.empty())
+			{
+				m_SpatialSplitBudget = budget;
+				leftReferences.clear();
+				rightReferences.clear();
+				spatialCost = FLT_MAX;
+			}
+		}
+
+		if (spatialCost == FLT_MAX || objectCost <= spatialCost)
+		{
+			if (objectCost == FLT_MAX)
+			{
+				makeLeaf();
+				return;
+			}
+
+			for (const SpatialReference& reference : references)
+			{
+				if (reference.bounds.Center()[objectSplit.axis] < objectSplit.position)
+					leftReferences.push_back(reference);
+				else
+					rightReferences.push_back(reference);
+			}
+
+			if (leftReferences.empty() || rightReferences.empty())
+			{
+				makeLeaf();
+				return;
+			}
+		}
+
+		//The node's own references are no longer needed while its subtrees are built
+		std::vector<SpatialReference>{}.swap(references);
+
+		AABB leftBounds{};
+		for (const SpatialReference& reference : leftReferences)
+		{
+			leftBounds.Grow(reference.bounds);
+		}
+		AABB rightBounds{};
+		for (const SpatialReference& reference : rightReferences)
+		{
+			rightBounds.Grow(reference.bounds);
+		}
+
+		const uint32_t leftChildIndex = static_cast<uint32_t>(m_Nodes.size());
+		m_Nodes[nodeIndex].leftFirst = leftChildIndex;
+		m_Nodes[nodeIndex].primitiveCount = 0;
+		m_Nodes.push_back(BVHNode{ leftBounds.min, 0, leftBounds.max, static_cast<uint32_t>(leftReferences.size()) });
+		m_Nodes.push_back(BVHNode{ rightBounds.min, 0, rightBounds.max, static_cast<uint32_t>(rightReferences.size()) });
+
+		SubdivideSpatial(leftChildIndex, depth + 1, leftReferences, rootArea);
+		SubdivideSpatial(leftChildIndex + 1, depth + 1, rightReferences, rootArea);
+	}
+
+	float BVH::FindObjectSplit(const std::vector<SpatialReference>& references, SpatialSplit& split) const
+	{
+		AABB centroidBounds{};
+		for (const SpatialReference& reference : references)
+		{
+			centroidBounds.Grow(reference.bounds.Center());
+		}
+
+		float bestCost = FLT_MAX;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float boundsMin = centroidBounds.min[axis];
+			const float boundsMax = centroidBounds.max[axis];
+			if (boundsMin == boundsMax)
+				continue;
+
+			AABB binBounds[BIN_COUNT]{};
+			uint32_t binCounts[BIN_COUNT]{};
+			const float scale = BIN_COUNT / (boundsMax - boundsMin);
+			for (const SpatialReference& reference : references)
+			{
+				const int binIndex = std::min(BIN_COUNT - 1, static_cast<int>((reference.bounds.Center()[axis] - boundsMin) * scale));
+				binBounds[binIndex].Grow(reference.bounds);
+				++binCounts[binIndex];
+			}
+
+			AABB leftBounds[BIN_COUNT - 1]{};
+			AABB rightBounds[BIN_COUNT - 1]{};
+			uint32_t leftCounts[BIN_COUNT - 1]{};
+			uint32_t rightCounts[BIN_COUNT - 1]{};
+			AABB leftSweep{};
+			AABB rightSweep{};
+			uint32_t leftSum = 0;
+			uint32_t rightSum = 0;
+			for (int i = 0; i < BIN_COUNT - 1; ++i)
+			{
+				leftSum += binCounts[i];
+				leftCounts[i] = leftSum;
+				leftSweep.Grow(binBounds[i]);
+				leftBounds[i] = leftSweep;
+
+				rightSum += binCounts[BIN_COUNT - 1 - i];
+				rightCounts[BIN_COUNT - 2 - i] = rightSum;
+				rightSweep.Grow(binBounds[BIN_COUNT - 1 - i]);
+				rightBounds[BIN_COUNT - 2 - i] = rightSweep;
+			}
+
+			const float binWidth = (boundsMax - boundsMin) / BIN_COUNT;
+			for (int i = 0; i < BIN_COUNT - 1; ++i)
+			{
+				if (leftCounts[i] == 0 || rightCounts[i] == 0)
+					continue;
+
+				const float cost = GetBlockCount(leftCounts[i]) * leftBounds[i].Area() + GetBlockCount(rightCounts[i]) * rightBounds[i].Area();
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					split = SpatialSplit{ axis, boundsMin + binWidth * (i + 1), leftBounds[i], rightBounds[i], leftCounts[i], rightCounts[i] };
+				}
+			}
+		}
+
+		return bestCost;
+	}
+
+	float BVH::FindSpatialSplit(const std::vector<SpatialReference>& references, const AABB& nodeBounds, SpatialSplit& split) const
+	{
+		const uint32_t count = static_cast<uint32_t>(references.size());
+
+		float bestCost = FLT_MAX;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float boundsMin = nodeBounds.min[axis];
+			const float boundsMax = nodeBounds.max[axis];
+			if (boundsMin >= boundsMax)
+				continue;
+
+			//Every reference is clipped into each bin it spans, entering the first one and leaving the last one
+			AABB binBounds[BIN_COUNT]{};
+			uint32_t entryCounts[BIN_COUNT]{};
+			uint32_t exitCounts[BIN_COUNT]{};
+			const float binWidth = (boundsMax - boundsMin) / BIN_COUNT;
+			const float scale = BIN_COUNT / (boundsMax - boundsMin);
+			for (const SpatialReference& reference : references)
+			{
+				const int firstBin = std::clamp(static_cast<int>((reference.bounds.min[axis] - boundsMin) * scale), 0, BIN_COUNT - 1);
+				const int lastBin = std::clamp(static_cast<int>((reference.bounds.max[axis] - boundsMin) * scale), firstBin, BIN_COUNT - 1);
+
+				SpatialReference remainder = reference;
+				for (int binIndex = firstBin; binIndex < lastBin; ++binIndex)
+				{
+					SpatialReference binPart{};
+					ClipReference(remainder, axis, boundsMin + binWidth * (binIndex + 1), binPart, remainder);
+					binBounds[binIndex].Grow(binPart.bounds);
+				}
+				binBounds[lastBin].Grow(remainder.bounds);
+				++entryCounts[firstBin];
+				++exitCounts[lastBin];
+			}
+
+			AABB leftBounds[BIN_COUNT - 1]{};
+			AABB rightBounds[BIN_COUNT - 1]{};
+			uint32_t leftCounts[BIN_COUNT - 1]{};
+			uint32_t rightCounts[BIN_COUNT - 1]{};
+			AABB leftSweep{};
+			AABB rightSweep{};
+			uint32_t leftSum = 0;
+			uint32_t rightSum = 0;
+			for (int i = 0; i < BIN_COUNT - 1; ++i)
+			{
+				leftSum += entryCounts[i];
+				leftCounts[i] = leftSum;
+				leftSweep.Grow(binBounds[i]);
+				leftBounds[i] = leftSweep;
+
+				rightSum += exitCounts[BIN_COUNT - 1 - i];
+				rightCounts[BIN_COUNT - 2 - i] = rightSum;
+				rightSweep.Grow(binBounds[BIN_COUNT - 1 - i]);
+				rightBounds[BIN_COUNT - 2 - i] = rightSweep;
+			}
+
+			for (int i = 0; i < BIN_COUNT - 1; ++i)
+			{
+				//A plane every reference crosses makes no progress, one that duplicates too many exceeds the budget
+				if (leftCounts[i] == 0 || rightCounts[i] == 0 || leftCounts[i] == count || rightCounts[i] == count
+					|| leftCounts[i] + rightCounts[i] - count > m_SpatialSplitBudget)
+				{
+					continue;
+				}
+
+				const float cost = GetBlockCount(leftCounts[i]) * leftBounds[i].Area() + GetBlockCount(rightCounts[i]) * rightBounds[i].Area();
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					split = SpatialSplit{ axis, boundsMin + binWidth * (i + 1), leftBounds[i], rightBounds[i], leftCounts[i], rightCounts[i] };
+				}
+			}
+		}
+
+		return bestCost;
+	}
+
+	void BVH::ClipReference(const SpatialReference& reference, int axis, float plane, SpatialReference& left, SpatialReference& right) const
+	{
+		AABB leftBounds{};
+		AABB rightBounds{};
+		if (m_pBuildPositions)
+		{
+			//Triangle vertices on either side plus the points where its edges cross the plane
+			const size_t firstIndex = reference.primitiveIndex * size_t{ 3 };
+			const Vector3 vertices[3] = { (*m_pBuildPositions)[(*m_pBuildIndices)[firstIndex]],
+				(*m_pBuildPositions)[(*m_pBuildIndices)[firstIndex + 1]], (*m_pBuildPositions)[(*m_pBuildIndices)[firstIndex + 2]] };
+			for (int i = 0; i < 3; ++i)
+			{
+				const Vector3& start = vertices[i];
+				const Vector3& end = vertices[(i + 1) % 3];
+				if (start[axis] <= plane)
+					leftBounds.Grow(start);
+				if (start[axis] >= plane)
+					rightBounds.Grow(start);
+
+				if ((start[axis] < plane && plane < end[axis]) || (end[axis] < plane && plane < start[axis]))
+				{
+					Vector3 crossing = start + (end - start) * ((plane - start[axis]) / (end[axis] - start[axis]));
+					crossing[axis] = plane;
+					leftBounds.Grow(crossing);
+					rightBounds.Grow(crossing);
+				}
+			}
+		}
+		else
+		{
+			//Only the bounds are known, each side keeps the part of them on its side
+			leftBounds = reference.bounds;
+			leftBounds.max[axis] = plane;
+			rightBounds = reference.bounds;
+			rightBounds.min[axis] = plane;
+		}
+
+		//Earlier splits already cut the reference down to its bounds
+		const auto clipToReference = [&](const AABB& bounds)
+			{
+				const AABB clipped{ Vector3::Max(bounds.min, reference.bounds.min), Vector3::Min(bounds.max, reference.bounds.max) };
+				if (clipped.min.x > clipped.max.x || clipped.min.y > clipped.max.y || clipped.min.z > clipped.max.z)
+					return AABB{};
+				return clipped;
+			};
+
+		left = SpatialReference{ clipToReference(leftBounds), reference.primitiveIndex };
+		right = SpatialReference{ clipToReference(rightBounds), reference.primitiveIndex };
+	}
+}
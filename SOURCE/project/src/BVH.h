@@ -0,0 +1,246 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Math.h"
+#include "SIMD.h"
+#include "WideBVH.h"
+
+namespace dae
+{
+	struct AABB final
+	{
+		Vector3 min{ FLT_MAX, FLT_MAX, FLT_MAX };
+		Vector3 max{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		void Grow(const Vector3& point)
+		{
+			min = Vector3::Min(min, point);
+			max = Vector3::Max(max, point);
+		}
+
+		void Grow(const AABB& other)
+		{
+			min = Vector3::Min(min, other.min);
+			max = Vector3::Max(max, other.max);
+		}
+
+		Vector3 Center() const
+		{
+			return (min + max) * 0.5f;
+		}
+
+		float Area() const
+		{
+			const Vector3 extent = max - min;
+			if (extent.x < 0.f || extent.y < 0.f || extent.z < 0.f)
+				return 0.f;
+
+			return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+		}
+	};
+
+	//32 bytes, two nodes per cache line
+	struct BVHNode final
+	{
+		Vector3 minAABB{};
+		uint32_t leftFirst{}; //Left child index for interior nodes, first primitive index for leaves
+		Vector3 maxAABB{};
+		uint32_t primitiveCount{};
+
+		bool IsLeaf() const { return primitiveCount > 0; }
+	};
+
+	class ThreadPool;
+
+	//Traversal stacks are sized to this, the builder never creates deeper trees
+	constexpr uint32_t BVH_MAX_DEPTH = 64;
+
+	enum class BVHBuildMode : uint32_t
+	{
+		//Binned surface area heuristic, the best trees for static geometry
+		SAH,
+		//Linear BVH: primitives sorted along a Morton curve and split at the highest differing code bit. An order of
+		//magnitude faster to build, meant for geometry that deforms and is rebuilt every frame.
+		Linear,
+		//Linear BVH with every node's treelet of up to 5 subtrees restructured to its lowest SAH cost afterwards
+		LinearTreelets,
+		//Binned SAH that may also split at a plane through primitives, cutting them into a clipped reference on each side.
+		//Primitives can then sit in several leaves. The slowest build, for final frames of static scenes with long thin
+		//triangles whose bounds overlap under any object split. Update rebuilds these trees with SAH.
+		SpatialSplits
+	};
+
+	//Everything besides the primitives that decides which tree a build produces, caches only reuse trees built with
+	//identical parameters. Only 4 byte members, so the struct has no padding and can be compared and hashed as bytes.
+	struct BVHBuildParameters final
+	{
+		uint32_t builderVersion{};
+		BVHBuildMode buildMode{};
+		uint32_t leafBlockWidth{};
+		uint32_t binCount{};
+		uint32_t maxLeafSize{};
+		float traversalCost{};
+	};
+
+	//Binary bounding volume hierarchy built with a binned surface area heuristic.
+	//The hierarchy only stores primitive indices, so the same builder serves triangles and whole scene objects.
+	class BVH final
+	{
+	public:
+		BVH() = default;
+		~BVH() = default;
+
+		BVH(const BVH&) = default;
+		BVH(BVH&&) noexcept = default;
+		BVH& operator=(const BVH&) = default;
+		BVH& operator=(BVH&&) noexcept = default;
+
+		void Build(const std::vector<AABB>& primitiveBounds);
+		void Build(const std::vector<Vector3>& positions, const std::vector<int>& indices);
+		//Adopts a tree Build produced earlier over primitiveCount primitives with the current build parameters, for example
+		//one read back from a cache. Returns false and leaves the BVH empty when a child or primitive index points outside
+		//the tree, a node is shared or unreachable, an interior node does not enclose its children, the tree is deeper than
+		//BVH_MAX_DEPTH or the leaves do not cover every primitive slot exactly once.
+		bool Assign(std::vector<BVHNode> nodes, std::vector<uint32_t> primitiveIndices, uint32_t primitiveCount);
+		void Clear();
+
+		//Recomputes node bounds bottom-up for moved primitives, the tree topology is kept as is
+		void Refit(const std::vector<AABB>& primitiveBounds);
+		void Refit(const std::vector<Vector3>& positions, const std::vector<int>& indices);
+
+		//Refits, but rebuilds instead once the SAH cost exceeds rebuildThreshold times the cost of the last build.
+		//A changed primitive count always rebuilds, a threshold of 0 rebuilds on every update without refitting first.
+		//Rebuilds of a spatial split tree switch it to SAH, spatial splits are only worth their build time for static geometry.
+		void Update(const std::vector<AABB>& primitiveBounds, float rebuildThreshold);
+		void Update(const std::vector<Vector3>& positions, const std::vector<int>& indices, float rebuildThreshold);
+
+		//SAH cost of the tree relative to the root area, lower is better
+		float CalculateCost() const;
+
+		//Leaves are intersected in SIMD blocks of this many primitives, the SAH then favours full blocks.
+		//Changing it discards the tree so the next Update rebuilds.
+		void SetLeafBlockWidth(uint32_t width);
+		uint32_t GetLeafBlockWidth() const { return m_LeafBlockWidth; }
+
+		//Changing the mode discards the tree so the next Update rebuilds
+		void SetBuildMode(BVHBuildMode buildMode);
+		BVHBuildMode GetBuildMode() const { return m_BuildMode; }
+
+		//Mode every BVH constructed afterwards starts with, SAH by default. Set once at startup, before any BVH is made.
+		//BVHs rebuilt every frame, such as the scene TLAS, set their own mode.
+		static void SetDefaultBuildMode(BVHBuildMode buildMode);
+		static BVHBuildMode GetDefaultBuildMode();
+
+		//The binary tree is collapsed into 4 or 8 wide nodes after every build and refit, 2 keeps the binary layout only.
+		//Defaults to the widest node the CPU can slab test in one pass.
+		void SetNodeWidth(uint32_t width);
+		uint32_t GetNodeWidth() const { return m_NodeWidth; }
+
+		BVHBuildParameters GetBuildParameters() const;
+
+		//Builds over many primitives bin the top of the tree with parallel reductions and build the subtrees below as tasks
+		//on this pool, producing the same tree as a single threaded build. Null (the default) builds on the calling thread.
+		//The pool has to outlive every build, and builds must not be started from inside one of its tasks.
+		static void SetThreadPool(ThreadPool* pThreadPool);
+
+		bool IsEmpty() const { return m_Nodes.empty(); }
+		uint32_t GetPrimitiveCount() const { return m_PrimitiveCount; }
+		const std::vector<BVHNode>& GetNodes() const { return m_Nodes; }
+		//One per leaf slot, more than GetPrimitiveCount when spatial splits put a primitive in several leaves
+		const std::vector<uint32_t>& GetPrimitiveIndices() const { return m_PrimitiveIndices; }
+		const std::vector<WideBVHNode4>& GetWideNodes4() const { return m_WideNodes4; }
+		const std::vector<WideBVHNode8>& GetWideNodes8() const { return m_WideNodes8; }
+
+	private:
+		//Bump whenever a change to the builder changes the trees it produces, so cached trees are rebuilt
+		static constexpr uint32_t BUILDER_VERSION = 2;
+		static constexpr int BIN_COUNT = 16;
+		//SAH cost of one node visit relative to intersecting one leaf block
+		static constexpr float TRAVERSAL_COST = 1.f;
+		//Leaves holding more primitives are split even when the SAH advises against it
+		static constexpr uint32_t MAX_LEAF_SIZE = 16;
+		//Linear builds stop splitting at one leaf block, but at least this many primitives
+		static constexpr uint32_t LINEAR_MIN_LEAF_SIZE = 4;
+		//Beyond this many primitives 30 bit codes put too many centroids in one cell, 63 bit codes take twice the sort passes
+		static constexpr uint32_t LINEAR_SHORT_CODE_MAX_PRIMITIVES = 1 << 18;
+		//Subtrees a treelet is restructured over, the optimization visits 3^5 splits per node
+		static constexpr uint32_t TREELET_SIZE = 5;
+		//Spatial splits are only tried where the children of the best object split overlap by more than this fraction of
+		//the root area, and never add more references than this fraction of the primitive count
+		static constexpr float SPATIAL_SPLIT_MIN_OVERLAP = 1e-5f;
+		static constexpr float SPATIAL_SPLIT_MAX_GROWTH = 0.5f;
+
+		std::vector<BVHNode> m_Nodes{};
+		std::vector<uint32_t> m_PrimitiveIndices{};
+		std::vector<WideBVHNode4> m_WideNodes4{};
+		std::vector<WideBVHNode8> m_WideNodes8{};
+
+		uint32_t m_PrimitiveCount{};
+		float m_BuildCost{};
+		bool m_IsRefitBaselinePending{}; //The next refit sets m_BuildCost, see IsRefitDegraded
+		uint32_t m_LeafBlockWidth{ 1 };
+		BVHBuildMode m_BuildMode{ GetDefaultBuildMode() };
+		uint32_t m_NodeWidth{ static_cast<uint32_t>(SIMD::GetBVHNodeWidth()) };
+
+		//Build scratch data, released once the build is done
+		std::vector<Vector3> m_Centroids{};
+		std::vector<uint32_t> m_PartitionScratch{};
+		std::vector<uint8_t> m_PartitionSides{}; //1 for primitives left of the split plane
+		//Triangles of Build(positions, indices), spatial splits clip them exactly instead of clipping their bounds
+		const std::vector<Vector3>* m_pBuildPositions{};
+		const std::vector<int>* m_pBuildIndices{};
+		uint32_t m_SpatialSplitBudget{}; //References spatial splits may still add
+
+		struct SplitBins;
+		struct SubtreeTask;
+		struct LinearSubtreeTask;
+		struct SpatialReference;
+		struct SpatialSplit;
+
+		void UpdateNodeBounds(BVHNode& node, const std::vector<AABB>& primitiveBounds, ThreadPool* pThreadPool) const;
+		//Splits the node with the best binned SAH split and appends its two children to nodes, false when it stays a leaf
+		bool SplitNode(std::vector<BVHNode>& nodes, uint32_t nodeIndex, uint32_t depth, const std::vector<AABB>& primitiveBounds,
+			ThreadPool* pThreadPool);
+		//Both return the number of primitives moved left of the split plane
+		uint32_t Partition(const BVHNode& node, int axis, float splitPosition);
+		uint32_t PartitionStable(const BVHNode& node, int axis, float splitPosition, ThreadPool* pThreadPool);
+		void Subdivide(std::vector<BVHNode>& nodes, uint32_t nodeIndex, uint32_t depth, const std::vector<AABB>& primitiveBounds);
+		//Subdivides the root in m_Nodes with the top levels binned on the pool and the subtrees below built as pool tasks
+		void SubdivideParallel(const std::vector<AABB>& primitiveBounds, ThreadPool& threadPool);
+		float FindBestSplit(const BVHNode& node, int& axis, float& splitPosition, const std::vector<AABB>& primitiveBounds,
+			ThreadPool* pThreadPool) const;
+
+		//Linear builder, 30 bit Morton codes for up to LINEAR_SHORT_CODE_MAX_PRIMITIVES primitives and 63 bit codes above
+		void BuildLinear(const std::vector<AABB>& primitiveBounds, ThreadPool* pThreadPool);
+		template<typename MortonCode>
+		void BuildLinear(const std::vector<AABB>& primitiveBounds, ThreadPool* pThreadPool);
+		//Emits the hierarchy over the sorted codes in linear time, false when it would be deeper than BVH_MAX_DEPTH
+		template<typename MortonCode>
+		bool EmitLinearHierarchy(const std::vector<MortonCode>& codes, const std::vector<AABB>& primitiveBounds, uint32_t leafSize,
+			ThreadPool* pThreadPool);
+		void OptimizeTreelets();
+
+		//Spatial split builder, single threaded. Takes the references of one node and emits its subtree depth first.
+		void BuildSpatial(const std::vector<AABB>& primitiveBounds);
+		void SubdivideSpatial(uint32_t nodeIndex, uint32_t depth, std::vector<SpatialReference>& references, float rootArea);
+		//Best binned object split of the references, fills the split and returns its SAH cost
+		float FindObjectSplit(const std::vector<SpatialReference>& references, SpatialSplit& split) const;
+		//Best split at a plane between spatial bins of the node bounds, within the remaining reference budget
+		float FindSpatialSplit(const std::vector<SpatialReference>& references, const AABB& nodeBounds, SpatialSplit& split) const;
+		//Cuts the part of a reference on either side of the plane, exactly for triangles and conservatively otherwise
+		void ClipReference(const SpatialReference& reference, int axis, float plane, SpatialReference& left, SpatialReference& right) const;
+
+		//Takes the cost after a refit, true when it grew past rebuildThreshold times the baseline
+		bool IsRefitDegraded(float rebuildThreshold);
+		void UseAnimatedBuildMode();
+
+		uint32_t GetBlockCount(uint32_t primitiveCount) const { return (primitiveCount + m_LeafBlockWidth - 1) / m_LeafBlockWidth; }
+
+		template<typename LeafBounds>
+		void RefitNodes(LeafBounds&& getPrimitiveBounds);
+
+		void CollapseWideNodes();
+		template<int Width>
+		uint32_t CollapseNode(uint32_t nodeIndex, std::vector<WideBVHNode<Width>>& wideNodes) const;
+	};
+}
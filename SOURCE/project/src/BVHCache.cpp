@@ -0,0 +1,139 @@
+#include <cstdio>
+#include <type_traits>
+#include "BVHCache.h"
+#include "CacheFile.h"
+
+namespace dae
+{
+	//Bump whenever the layout below or the layout of a stored type changes, older caches are then rebuilt
+	static constexpr uint32_t BVH_CACHE_VERSION = 3;
+	static constexpr char BVH_CACHE_MAGIC[8] = { 'D', 'A', 'E', 'B', 'V', 'H', '\0', '\0' };
+
+	static_assert(sizeof(BVHNode) == 32 && std::is_trivially_copyable_v<BVHNode>);
+
+	struct BVHCacheHeader final
+	{
+		char magic[8]{};
+		uint32_t version{};
+		uint32_t triangleCount{};
+		uint64_t trianglesHash{};
+		BVHBuildParameters parameters{};
+		uint32_t nodeCount{};
+		uint32_t primitiveIndexCount{}; //At least triangleCount, spatial splits reference triangles more than once
+		uint64_t nodesOffset{}; //Bytes from the start of the file
+		uint64_t primitiveIndicesOffset{};
+	};
+
+	static_assert(std::is_trivially_copyable_v<BVHCacheHeader>);
+
+	static std::string g_Directory{};
+
+	void BVHCache::SetDirectory(const std::string& directory)
+	{
+		g_Directory = directory;
+	}
+
+	const std::string& BVHCache::GetDirectory()
+	{
+		return g_Directory;
+	}
+
+	uint64_t BVHCache::HashTriangles(const std::vector<Vector3>& positions, const std::vector<int>& indices)
+	{
+		const uint64_t positionsHash = CacheFile::Hash(positions.data(), positions.size() * sizeof(Vector3));
+		return CacheFile::Hash(indices.data(), indices.size() * sizeof(int), positionsHash);
+	}
+
+	std::string BVHCache::GetFilename(const BVH& bvh, uint64_t trianglesHash)
+	{
+		const BVHBuildParameters parameters = bvh.GetBuildParameters();
+		const uint64_t key = CacheFile::Hash(&parameters, sizeof(BVHBuildParameters), trianglesHash);
+
+		char name[32]{};
+		std::snprintf(name, sizeof(name), "%016llx.bvh", static_cast<unsigned long long>(key));
+		return (std::filesystem::path{ g_Directory } / name).string();
+	}
+
+	bool BVHCache::Save(const std::string& filename, const BVH& bvh, uint64_t trianglesHash)
+	{
+		const std::vector<BVHNode>& nodes = bvh.GetNodes();
+		const std::vector<uint32_t>& primitiveIndices = bvh.GetPrimitiveIndices();
+
+		BVHCacheHeader header{};
+		std::memcpy(header.magic, BVH_CACHE_MAGIC, sizeof(header.magic));
+		header.version = BVH_CACHE_VERSION;
+		header.triangleCount = bvh.GetPrimitiveCount();
+		header.trianglesHash = trianglesHash;
+		header.parameters = bvh.GetBuildParameters();
+		header.nodeCount = static_cast<uint32_t>(nodes.size());
+		header.primitiveIndexCount = static_cast<uint32_t>(primitiveIndices.size());
+		header.nodesOffset = CacheFile::AlignSectionOffset(sizeof(BVHCacheHeader));
+		header.primitiveIndicesOffset = CacheFile::AlignSectionOffset(header.nodesOffset + nodes.size() * sizeof(BVHNode));
+
+		std::error_code error{};
+		const std::filesystem::path directory = std::filesystem::path{ filename }.parent_path();
+		if (!directory.empty())
+			std::filesystem::create_directories(directory, error);
+
+		//Build parameters and triangles are in the name, so concurrent renders of the same assets write identical files
+		const std::string temporaryFilename = CacheFile::GetTemporaryFilename(filename);
+		std::ofstream stream{ temporaryFilename, std::ios::binary | std::ios::trunc };
+		if (!stream)
+			return false;
+
+		stream.write(reinterpret_cast<const char*>(&header), sizeof(BVHCacheHeader));
+		uint64_t position = sizeof(BVHCacheHeader);
+		CacheFile::WriteSection(stream, position, header.nodesOffset, nodes);
+		CacheFile::WriteSection(stream, position, header.primitiveIndicesOffset, primitiveIndices);
+		return CacheFile::Commit(stream, temporaryFilename, filename);
+	}
+
+	bool BVHCache::Load(const std::string& filename, BVH& bvh, uint64_t trianglesHash, uint32_t triangleCount)
+	{
+		MappedFile file{};
+		if (!file.Open(filename) || file.GetSize() < sizeof(BVHCacheHeader))
+			return false;
+
+		BVHCacheHeader header{};
+		std::memcpy(&header, file.GetData(), sizeof(BVHCacheHeader));
+
+		const BVHBuildParameters parameters = bvh.GetBuildParameters();
+		if (std::memcmp(header.magic, BVH_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != BVH_CACHE_VERSION
+			|| header.trianglesHash != trianglesHash || header.triangleCount != triangleCount
+			|| std::memcmp(&header.parameters, &parameters, sizeof(BVHBuildParameters)) != 0)
+		{
+			return false;
+		}
+
+		std::vector<BVHNode> nodes{};
+		std::vector<uint32_t> primitiveIndices{};
+		if (!CacheFile::ReadSection(file, header.nodesOffset, header.nodeCount, nodes)
+			|| !CacheFile::ReadSection(file, header.primitiveIndicesOffset, header.primitiveIndexCount, primitiveIndices))
+		{
+			return false;
+		}
+
+		//Assign validates every index and the nesting of the node bounds
+		return bvh.Assign(std::move(nodes), std::move(primitiveIndices), triangleCount);
+	}
+
+	bool BVHCache::Build(BVH& bvh, const std::vector<Vector3>& positions, const std::vector<int>& indices)
+	{
+		const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+		if (g_Directory.empty() || triangleCount < MIN_TRIANGLE_COUNT)
+		{
+			bvh.Build(positions, indices);
+			return false;
+		}
+
+		const uint64_t trianglesHash = HashTriangles(positions, indices);
+		const std::string filename = GetFilename(bvh, trianglesHash);
+		if (Load(filename, bvh, trianglesHash, triangleCount))
+			return true;
+
+		bvh.Build(positions, indices);
+		//A cache that can not be written only costs the next run the build
+		Save(filename, bvh, trianglesHash);
+		return false;
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "BVH.h"
+
+namespace dae
+{
+	//On-disk store of built triangle BVHs, keyed by a hash of the triangles and the build parameters, so rendering the
+	//same assets again skips the build. Disabled until a directory is set.
+	namespace BVHCache
+	{
+		//Smaller meshes build faster than their cache file opens, they are never cached
+		constexpr uint32_t MIN_TRIANGLE_COUNT = 1024;
+
+		//Set once at startup, before any mesh is built. An empty directory (the default) disables the cache.
+		void SetDirectory(const std::string& directory);
+		const std::string& GetDirectory();
+
+		//Hash of the vertex positions and indices a triangle BVH is built from
+		uint64_t HashTriangles(const std::vector<Vector3>& positions, const std::vector<int>& indices);
+
+		//Cache file of the tree bvh's current build parameters would produce for triangles with this hash
+		std::string GetFilename(const BVH& bvh, uint64_t trianglesHash);
+
+		//Writes the tree of bvh, tagged with the hash of the triangles it was built over and its build parameters
+		bool Save(const std::string& filename, const BVH& bvh, uint64_t trianglesHash);
+
+		//Adopts a tree written by Save for the same triangle hash and the build parameters bvh currently has.
+		//Returns false when the file is missing or was made from other input, bvh is then untouched, or when the stored
+		//tree is invalid, bvh is then left empty.
+		bool Load(const std::string& filename, BVH& bvh, uint64_t trianglesHash, uint32_t triangleCount);
+
+		//Builds bvh over the triangles like BVH::Build, but reuses a tree an earlier build of the same triangles and
+		//build parameters stored in the cache directory, and stores the trees it does build there.
+		//Returns true when the tree came from the cache.
+		bool Build(BVH& bvh, const std::vector<Vector3>& positions, const std::vector<int>& indices);
+	}
+}
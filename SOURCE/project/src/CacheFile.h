@@ -0,0 +1,103 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+namespace dae
+{
+	//Building blocks of the binary cache files: a fixed header followed by raw copies of vectors, each section starting
+	//on a cache line boundary. Files are read back through a MappedFile and only valid on machines with the same
+	//endianness and type layout, every cache format guards that with its own version.
+	namespace CacheFile
+	{
+		constexpr uint64_t SECTION_ALIGNMENT = 64;
+
+		inline uint64_t AlignSectionOffset(uint64_t offset)
+		{
+			return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+		}
+
+		//Copies count elements at offset out of the mapping, false when the section does not fit inside the file
+		template<typename T>
+		bool ReadSection(const MappedFile& file, uint64_t offset, uint32_t count, std::vector<T>& values)
+		{
+			const uint64_t size = uint64_t{ count } * sizeof(T);
+			if (offset > file.GetSize() || size > file.GetSize() - offset)
+				return false;
+
+			values.resize(count);
+			if (size > 0)
+				std::memcpy(values.data(), file.GetData() + offset, size);
+			return true;
+		}
+
+		//Pads the stream from position up to offset and writes the section there, position ends up behind it
+		template<typename T>
+		void WriteSection(std::ofstream& stream, uint64_t& position, uint64_t offset, const std::vector<T>& values)
+		{
+			static constexpr char padding[SECTION_ALIGNMENT]{};
+			stream.write(padding, static_cast<std::streamsize>(offset - position));
+
+			const uint64_t size = values.size() * sizeof(T);
+			stream.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(size));
+			position = offset + size;
+		}
+
+		//Unique name next to filename to write a new cache to, so concurrent writers of the same cache never share a file
+		inline std::string GetTemporaryFilename(const std::string& filename)
+		{
+			return filename + "." + std::to_string(std::random_device{}()) + ".tmp";
+		}
+
+		//Renames a completely written temporary file over filename, so readers never map a half written cache.
+		//The temporary file is removed when that fails.
+		inline bool Commit(std::ofstream& stream, const std::string& temporaryFilename, const std::string& filename)
+		{
+			const bool isWritten = static_cast<bool>(stream.flush());
+			stream.close();
+
+			std::error_code error{};
+			if (isWritten)
+				std::filesystem::rename(temporaryFilename, filename, error);
+			if (!isWritten || error)
+			{
+				std::filesystem::remove(temporaryFilename, error);
+				return false;
+			}
+			return true;
+		}
+
+		//64 bit content hash, eight bytes per step, used to key caches on the data they were made from
+		inline uint64_t Hash(const void* pData, size_t size, uint64_t seed = 0)
+		{
+			//splitmix64 finalizer
+			const auto mix = [](uint64_t value)
+				{
+					value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+					value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+					return value ^ (value >> 31);
+				};
+
+			const unsigned char* pBytes = static_cast<const unsigned char*>(pData);
+			uint64_t hash = mix(seed ^ (size * 0x9E3779B97F4A7C15ull));
+
+			size_t offset = 0;
+			for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t))
+			{
+				uint64_t word{};
+				std::memcpy(&word, pBytes + offset, sizeof(uint64_t));
+				hash = std::rotl(hash ^ (word * 0x9E3779B97F4A7C15ull), 29) * 0xC2B2AE3D27D4EB4Full;
+			}
+
+			uint64_t tail{};
+			std::memcpy(&tail, pBytes + offset, size - offset);
+			return mix(hash ^ tail);
+		}
+	}
+}
@@ -2,6 +2,10 @@
 #include <stdexcept>
 #include <vector>
 #include "Math.h"
+#include "BVH.h"
+#include "BVHCache.h"
+#include "SIMD.h"
+#include "TriangleBlock.h"
 
 namespace dae
 {
@@ -53,6 +57,17 @@ namespace dae
 		unsigned char materialIndex{};
 	};
 
+	//Intersection-ready triangle: one cache line holding everything Möller-Trumbore and the hit record need
+	struct alignas(64) TriangleRecord final
+	{
+		Vector3 v0{};
+		Vector3 edge1{}; //v1 - v0
+		Vector3 edge2{}; //v2 - v0
+		Vector3 normal{};
+
+		unsigned char materialIndex{}; //Stamped from the mesh on every UpdateTransforms
+	};
+
 	struct TriangleMesh final
 	{
 		TriangleMesh() = default;
@@ -94,6 +109,19 @@ namespace dae
 		std::vector<Vector3> transformedPositions{};
 		std::vector<Vector3> transformedNormals{};
 
+		//Built over transformedPositions, primitive indices are triangle indices (index into indices / 3)
+		BVH bvh{};
+		//Transform updates refit the BVH and only rebuild once its SAH cost grew past this factor. 0 rebuilds on every
+		//update, meant for deforming meshes together with BVHBuildMode::Linear.
+		float bvhRebuildThreshold{ 1.5f };
+		//One record per triangle in BVH primitive order, so leaf slots index it directly
+		std::vector<TriangleRecord> triangleRecords{};
+		//SIMD blocks of each leaf's triangles, only the vector matching triangleBlockWidth is filled (none when scalar)
+		int triangleBlockWidth{ 1 };
+		std::vector<TriangleBlock4> triangleBlocks4{};
+		std::vector<TriangleBlock8> triangleBlocks8{};
+		std::vector<uint32_t> leafBlockOffsets{}; //First block of every leaf, indexed by BVH node
+
 		void Translate(const Vector3& translation)
 		{
 			translationTransform = Matrix::CreateTranslation(translation);
@@ -165,6 +193,19 @@ namespace dae
 			}
 
 			UpdateTransformedAABB(finalTransform);
+
+			triangleBlockWidth = SIMD::GetTriangleBlockWidth();
+			bvh.SetLeafBlockWidth(triangleBlockWidth);
+			//The first build can come from the BVH cache, later ones follow the animation
+			if (bvh.IsEmpty() || bvh.GetPrimitiveCount() != indices.size() / 3)
+				BVHCache::Build(bvh, transformedPositions, indices);
+			else
+				bvh.Update(transformedPositions, indices, bvhRebuildThreshold);
+			UpdateTriangleRecords();
+			if (triangleBlockWidth == 8)
+				UpdateTriangleBlocks(triangleBlocks8);
+			else if (triangleBlockWidth == 4)
+				UpdateTriangleBlocks(triangleBlocks4);
 			
 			transformedNormals.clear();
 			transformedNormals.reserve(normals.size());
@@ -176,6 +217,52 @@ namespace dae
 			}
 		}
 
+		void UpdateTriangleRecords()
+		{
+			const std::vector<uint32_t>& primitiveIndices = bvh.GetPrimitiveIndices();
+			triangleRecords.resize(primitiveIndices.size());
+
+			for (size_t slot = 0; slot < primitiveIndices.size(); ++slot)
+			{
+				const size_t firstIndex = primitiveIndices[slot] * size_t{ 3 };
+				const Vector3& v0 = transformedPositions[indices[firstIndex]];
+
+				TriangleRecord& record = triangleRecords[slot];
+				record.v0 = v0;
+				record.edge1 = transformedPositions[indices[firstIndex + 1]] - v0;
+				record.edge2 = transformedPositions[indices[firstIndex + 2]] - v0;
+				record.normal = Vector3::Cross(record.edge1, record.edge2).Normalized();
+				record.materialIndex = materialIndex;
+			}
+		}
+
+		template<int Width>
+		void UpdateTriangleBlocks(std::vector<TriangleBlock<Width>>& blocks)
+		{
+			const std::vector<BVHNode>& nodes = bvh.GetNodes();
+			blocks.clear();
+			leafBlockOffsets.resize(nodes.size());
+
+			for (size_t nodeIndex = 0; nodeIndex < nodes.size(); ++nodeIndex)
+			{
+				const BVHNode& node = nodes[nodeIndex];
+				if (!node.IsLeaf())
+					continue;
+
+				leafBlockOffsets[nodeIndex] = static_cast<uint32_t>(blocks.size());
+				for (uint32_t first = 0; first < node.primitiveCount; first += Width)
+				{
+					TriangleBlock<Width>& block = blocks.emplace_back();
+					const uint32_t laneCount = std::min(static_cast<uint32_t>(Width), node.primitiveCount - first);
+					for (uint32_t lane = 0; lane < laneCount; ++lane)
+					{
+						const TriangleRecord& record = triangleRecords[node.leftFirst + first + lane];
+						block.SetLane(lane, record.v0, record.edge1, record.edge2);
+					}
+				}
+			}
+		}
+
 		void UpdateAABB()
 		{
 			if (positions.empty())
@@ -225,6 +312,73 @@ namespace dae
 			transformedMaxAABB = tMaxAABB;
 		}
 	};
+
+	//Places a shared TriangleMesh in the world without copying it. The mesh (vertices, BVH) is treated as immutable,
+	//rays are moved into the space of its transformedPositions instead, so moving an instance is O(1).
+	struct TriangleMeshInstance final
+	{
+		TriangleMeshInstance() = default;
+		TriangleMeshInstance(const TriangleMesh* _pMesh, TriangleCullMode _cullMode, unsigned char _materialIndex) :
+			pMesh(_pMesh), materialIndex(_materialIndex), cullMode(_cullMode)
+		{
+			UpdateTransforms();
+		}
+
+		const TriangleMesh* pMesh{};
+		unsigned char materialIndex{};
+
+		TriangleCullMode cullMode{ TriangleCullMode::BackFaceCulling };
+
+		Matrix rotationTransform{};
+		Matrix translationTransform{};
+		Matrix scaleTransform{};
+
+		Matrix worldToObject{};
+		Matrix normalToWorld{}; //Inverse transpose of the object to world transform
+
+		Vector3 transformedMinAABB{};
+		Vector3 transformedMaxAABB{};
+
+		void Translate(const Vector3& translation)
+		{
+			translationTransform = Matrix::CreateTranslation(translation);
+		}
+
+		void RotateY(float yaw)
+		{
+			rotationTransform = Matrix::CreateRotationY(yaw);
+		}
+
+		void Scale(const Vector3& scale)
+		{
+			scaleTransform = Matrix::CreateScale(scale);
+		}
+
+		void UpdateTransforms()
+		{
+			const auto objectToWorld = rotationTransform * translationTransform * scaleTransform;
+			worldToObject = Matrix::Inverse(objectToWorld);
+			normalToWorld = Matrix::Transpose(worldToObject);
+
+			if (!pMesh)
+				return;
+
+			//World bounds of the transformed mesh bounds corners
+			const Vector3& minAABB = pMesh->transformedMinAABB;
+			const Vector3& maxAABB = pMesh->transformedMaxAABB;
+			transformedMinAABB = Vector3{ FLT_MAX, FLT_MAX, FLT_MAX };
+			transformedMaxAABB = Vector3{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				const Vector3 tAABB = objectToWorld.TransformPoint(
+					(corner & 1) ? maxAABB.x : minAABB.x,
+					(corner & 2) ? maxAABB.y : minAABB.y,
+					(corner & 4) ? maxAABB.z : minAABB.z);
+				transformedMinAABB = Vector3::Min(tAABB, transformedMinAABB);
+				transformedMaxAABB = Vector3::Max(tAABB, transformedMaxAABB);
+			}
+		}
+	};
 #pragma endregion
 #pragma region LIGHT
 	enum class LightType
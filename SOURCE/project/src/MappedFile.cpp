@@ -0,0 +1,118 @@
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dae
+{
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+#if defined(_WIN32)
+	bool MappedFile::Open(const std::string& path)
+	{
+		Close();
+
+		const HANDLE fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (fileHandle == INVALID_HANDLE_VALUE)
+			return false;
+		m_FileHandle = fileHandle;
+
+		LARGE_INTEGER fileSize{};
+		if (!GetFileSizeEx(fileHandle, &fileSize))
+		{
+			Close();
+			return false;
+		}
+		m_Size = static_cast<size_t>(fileSize.QuadPart);
+
+		//Empty files can not be mapped
+		if (m_Size == 0)
+			return true;
+
+		m_MappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!m_MappingHandle)
+		{
+			Close();
+			return false;
+		}
+
+		m_pData = static_cast<const char*>(MapViewOfFile(m_MappingHandle, FILE_MAP_READ, 0, 0, 0));
+		if (!m_pData)
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (m_pData)
+			UnmapViewOfFile(m_pData);
+		if (m_MappingHandle)
+			CloseHandle(m_MappingHandle);
+		if (m_FileHandle)
+			CloseHandle(m_FileHandle);
+
+		m_pData = nullptr;
+		m_Size = 0;
+		m_MappingHandle = nullptr;
+		m_FileHandle = nullptr;
+	}
+#else
+	bool MappedFile::Open(const std::string& path)
+	{
+		Close();
+
+		const int fileDescriptor = open(path.c_str(), O_RDONLY);
+		if (fileDescriptor < 0)
+			return false;
+
+		struct stat fileStatus {};
+		if (fstat(fileDescriptor, &fileStatus) != 0)
+		{
+			close(fileDescriptor);
+			return false;
+		}
+		m_Size = static_cast<size_t>(fileStatus.st_size);
+
+		//The mapping keeps its own reference to the file, so the descriptor is not needed afterwards
+		if (m_Size > 0)
+		{
+			void* pMapping = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+			if (pMapping == MAP_FAILED)
+			{
+				close(fileDescriptor);
+				m_Size = 0;
+				return false;
+			}
+			madvise(pMapping, m_Size, MADV_SEQUENTIAL);
+			m_pData = static_cast<const char*>(pMapping);
+		}
+
+		close(fileDescriptor);
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (m_pData)
+			munmap(const_cast<char*>(m_pData), m_Size);
+
+		m_pData = nullptr;
+		m_Size = 0;
+	}
+#endif
+}
@@ -1,10 +1,54 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
 #include "Math.h"
 #include "DataTypes.h"
 #include "BRDFs.h"
 
 namespace dae
 {
+#pragma region Material TABLE ENTRY
+	enum class MaterialType : uint8_t
+	{
+		SolidColor,
+		Lambert,
+		LambertPhong,
+		CookTorrence
+	};
+
+	struct LambertParameters final
+	{
+		float diffuseReflectance; //kd
+	};
+
+	struct LambertPhongParameters final
+	{
+		float diffuseReflectance; //kd
+		float specularReflectance; //ks
+		float phongExponent;
+	};
+
+	struct CookTorrenceParameters final
+	{
+		float metalness;
+		float roughness;
+	};
+
+	//Flat copy of a material's parameters, tagged with its type. The scene keeps these in one contiguous table
+	//indexed like its materials, so shading switches on the type instead of making a virtual call per hit.
+	struct MaterialData final
+	{
+		MaterialType type{ MaterialType::SolidColor };
+		ColorRGB color{ colors::White }; //Solid color, diffuse color or albedo, depending on the type
+		union
+		{
+			LambertParameters lambert{};
+			LambertPhongParameters lambertPhong;
+			CookTorrenceParameters cookTorrence;
+		};
+	};
+#pragma endregion
+
 #pragma region Material BASE
 	class Material
 	{
@@ -25,6 +69,12 @@ namespace dae
 		 * \return color
 		 */
 		virtual ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) = 0;
+
+		/**
+		 * \brief Parameters of this material for the scene's material table
+		 * \return type tagged copy of the parameters
+		 */
+		virtual MaterialData GetData() const = 0;
 	};
 #pragma endregion
 
@@ -41,6 +91,14 @@ namespace dae
 			return m_Color;
 		}
 
+		MaterialData GetData() const override
+		{
+			MaterialData data{};
+			data.type = MaterialType::SolidColor;
+			data.color = m_Color;
+			return data;
+		}
+
 	private:
 		ColorRGB m_Color{ colors::White };
 	};
@@ -56,9 +114,23 @@ namespace dae
 			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(diffuseReflectance) {}
 
 		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) override
+		{
+			return Evaluate(m_DiffuseColor, m_DiffuseReflectance, hitRecord, l);
+		}
+
+		MaterialData GetData() const override
+		{
+			MaterialData data{};
+			data.type = MaterialType::Lambert;
+			data.color = m_DiffuseColor;
+			data.lambert = { m_DiffuseReflectance };
+			return data;
+		}
+
+		static ColorRGB Evaluate(const ColorRGB& diffuseColor, float diffuseReflectance, const HitRecord& hitRecord, const Vector3& l)
 		{
 			float lambertCosineLaw = std::max(0.0f, Vector3::Dot(hitRecord.normal, l));
-			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor) * lambertCosineLaw;
+			return BRDF::Lambert(diffuseReflectance, diffuseColor) * lambertCosineLaw;
 		}
 
 	private:
@@ -79,8 +151,23 @@ namespace dae
 
 		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) override
 		{
-			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor) 
-				+ BRDF::Phong(m_SpecularReflectance, m_PhongExponent, l, v, hitRecord.normal);
+			return Evaluate(m_DiffuseColor, { m_DiffuseReflectance, m_SpecularReflectance, m_PhongExponent }, hitRecord, l, v);
+		}
+
+		MaterialData GetData() const override
+		{
+			MaterialData data{};
+			data.type = MaterialType::LambertPhong;
+			data.color = m_DiffuseColor;
+			data.lambertPhong = { m_DiffuseReflectance, m_SpecularReflectance, m_PhongExponent };
+			return data;
+		}
+
+		static ColorRGB Evaluate(const ColorRGB& diffuseColor, const LambertPhongParameters& parameters, const HitRecord& hitRecord,
+			const Vector3& l, const Vector3& v)
+		{
+			return BRDF::Lambert(parameters.diffuseReflectance, diffuseColor)
+				+ BRDF::Phong(parameters.specularReflectance, parameters.phongExponent, l, v, hitRecord.normal);
 		}
 
 	private:
@@ -101,26 +188,41 @@ namespace dae
 			m_Albedo(albedo), m_Metalness(metalness), m_Roughness(roughness) {}
 
 		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) override
+		{
+			return Evaluate(m_Albedo, { m_Metalness, m_Roughness }, hitRecord, l, v);
+		}
+
+		MaterialData GetData() const override
+		{
+			MaterialData data{};
+			data.type = MaterialType::CookTorrence;
+			data.color = m_Albedo;
+			data.cookTorrence = { m_Metalness, m_Roughness };
+			return data;
+		}
+
+		static ColorRGB Evaluate(const ColorRGB& albedo, const CookTorrenceParameters& parameters, const HitRecord& hitRecord,
+			const Vector3& l, const Vector3& v)
 		{
 			Vector3 h = (l + v).Normalized();
 			float nDotV = std::max(0.0f, Vector3::Dot(hitRecord.normal, v));
 			float lambertCosineLaw = std::max(0.0f, Vector3::Dot(hitRecord.normal, l));
 			const float epsilon = 1e-6f;
 
-			ColorRGB f0 = ColorRGB::Lerp(ColorRGB{ 0.04f, 0.04f, 0.04f }, m_Albedo, m_Metalness);
+			ColorRGB f0 = ColorRGB::Lerp(ColorRGB{ 0.04f, 0.04f, 0.04f }, albedo, parameters.metalness);
 
-			float D = BRDF::NormalDistribution_GGX(hitRecord.normal, h, m_Roughness);
+			float D = BRDF::NormalDistribution_GGX(hitRecord.normal, h, parameters.roughness);
 			ColorRGB F = BRDF::FresnelFunction_Schlick(h, v, f0);
-			float G = BRDF::GeometryFunction_Smith(hitRecord.normal, v, l, m_Roughness);
+			float G = BRDF::GeometryFunction_Smith(hitRecord.normal, v, l, parameters.roughness);
 
 			ColorRGB specularNumerator = D * G * F;
 			float specularDenominator = 4.0f * nDotV * lambertCosineLaw + epsilon;
 			ColorRGB specular = specularNumerator / specularDenominator;
 
-			ColorRGB kD = (ColorRGB{ 1.f, 1.f, 1.f } - F) * (1.0f - m_Metalness);
-			ColorRGB diffuse = (kD * m_Albedo / PI);
+			ColorRGB kD = (ColorRGB{ 1.f, 1.f, 1.f } - F) * (1.0f - parameters.metalness);
+			ColorRGB diffuse = (kD * albedo / PI);
 
-			return (diffuse + specular);	
+			return (diffuse + specular);
 		}
 
 	private:
@@ -129,4 +231,72 @@ namespace dae
 		float m_Roughness{ 0.1f }; // [1.0 > 0.0] >> [ROUGH > SMOOTH]
 	};
 #pragma endregion
+
+#pragma region Material TABLE SHADING
+	namespace MaterialUtils
+	{
+		/**
+		 * \brief Shades a hit with a material table entry, same result as the material's own Shade
+		 * \param material table entry of the hit material
+		 * \param hitRecord current hitrecord
+		 * \param l light direction
+		 * \param v view direction
+		 * \return color
+		 */
+		inline ColorRGB Shade(const MaterialData& material, const HitRecord& hitRecord, const Vector3& l, const Vector3& v)
+		{
+			switch (material.type)
+			{
+			case MaterialType::Lambert:
+				return Material_Lambert::Evaluate(material.color, material.lambert.diffuseReflectance, hitRecord, l);
+			case MaterialType::LambertPhong:
+				return Material_LambertPhong::Evaluate(material.color, material.lambertPhong, hitRecord, l, v);
+			case MaterialType::CookTorrence:
+				return Material_CookTorrence::Evaluate(material.color, material.cookTorrence, hitRecord, l, v);
+			case MaterialType::SolidColor:
+			default:
+				return material.color;
+			}
+		}
+
+		/**
+		 * \brief Shades a batch of hits on one material, switching on its type once for the whole batch
+		 * \param material table entry shared by every hit of the batch
+		 * \param pHitRecords hitrecords of the batch
+		 * \param pLightDirections light direction per hit
+		 * \param pViewDirections view direction per hit
+		 * \param pColors receives the color per hit
+		 * \param count number of hits in the batch
+		 */
+		inline void ShadeBatch(const MaterialData& material, const HitRecord* pHitRecords, const Vector3* pLightDirections,
+			const Vector3* pViewDirections, ColorRGB* pColors, uint32_t count)
+		{
+			switch (material.type)
+			{
+			case MaterialType::Lambert:
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					pColors[i] = Material_Lambert::Evaluate(material.color, material.lambert.diffuseReflectance, pHitRecords[i], pLightDirections[i]);
+				}
+				break;
+			case MaterialType::LambertPhong:
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					pColors[i] = Material_LambertPhong::Evaluate(material.color, material.lambertPhong, pHitRecords[i], pLightDirections[i], pViewDirections[i]);
+				}
+				break;
+			case MaterialType::CookTorrence:
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					pColors[i] = Material_CookTorrence::Evaluate(material.color, material.cookTorrence, pHitRecords[i], pLightDirections[i], pViewDirections[i]);
+				}
+				break;
+			case MaterialType::SolidColor:
+			default:
+				std::fill(pColors, pColors + count, material.color);
+				break;
+			}
+		}
+	}
+#pragma endregion
 }
@@ -1,4 +1,6 @@
 #pragma once
+#include <cassert>
+#include "SIMD.h"
 #include "Vector3.h"
 #include "Vector4.h"
 
@@ -72,4 +74,86 @@ namespace dae {
 		// v2x v2y v2z v2w
 		// v3x v3y v3z v3w
 	};
+
+	//Transforms run for every instanced ray and every animated vertex, so they are defined here to inline.
+	//A row-major transform is a sum of the rows scaled by the components, which maps directly onto SSE lanes.
+	//The products and sums happen in the same order as the scalar fallback, so both give identical results.
+#pragma region Inline Definitions
+	inline Vector3 Matrix::TransformVector(const Vector3& v) const
+	{
+		return TransformVector(v.x, v.y, v.z);
+	}
+
+	inline Vector3 Matrix::TransformVector(float x, float y, float z) const
+	{
+#if defined(DAE_SIMD_X86)
+		const __m128 result = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(SIMD::Load(data[0]), _mm_set1_ps(x)),
+			_mm_mul_ps(SIMD::Load(data[1]), _mm_set1_ps(y))),
+			_mm_mul_ps(SIMD::Load(data[2]), _mm_set1_ps(z)));
+		return SIMD::Store(result).GetXYZ();
+#else
+		return Vector3{
+			data[0].x * x + data[1].x * y + data[2].x * z,
+			data[0].y * x + data[1].y * y + data[2].y * z,
+			data[0].z * x + data[1].z * y + data[2].z * z
+		};
+#endif
+	}
+
+	inline Vector3 Matrix::TransformPoint(const Vector3& p) const
+	{
+		return TransformPoint(p.x, p.y, p.z);
+	}
+
+	inline Vector3 Matrix::TransformPoint(float x, float y, float z) const
+	{
+#if defined(DAE_SIMD_X86)
+		return TransformPoint(x, y, z, 1.f).GetXYZ();
+#else
+		return Vector3{
+			data[0].x * x + data[1].x * y + data[2].x * z + data[3].x,
+			data[0].y * x + data[1].y * y + data[2].y * z + data[3].y,
+			data[0].z * x + data[1].z * y + data[2].z * z + data[3].z,
+		};
+#endif
+	}
+
+	inline Vector4 Matrix::TransformPoint(const Vector4& p) const
+	{
+		return TransformPoint(p.x, p.y, p.z, p.w);
+	}
+
+	//Like the scalar version the translation row is added as is, w only comes from it and does not scale it
+	inline Vector4 Matrix::TransformPoint(float x, float y, float z, float w) const
+	{
+#if defined(DAE_SIMD_X86)
+		const __m128 result = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(SIMD::Load(data[0]), _mm_set1_ps(x)),
+			_mm_mul_ps(SIMD::Load(data[1]), _mm_set1_ps(y))),
+			_mm_mul_ps(SIMD::Load(data[2]), _mm_set1_ps(z))),
+			SIMD::Load(data[3]));
+		return SIMD::Store(result);
+#else
+		return Vector4{
+			data[0].x * x + data[1].x * y + data[2].x * z + data[3].x,
+			data[0].y * x + data[1].y * y + data[2].y * z + data[3].y,
+			data[0].z * x + data[1].z * y + data[2].z * z + data[3].z,
+			data[0].w * x + data[1].w * y + data[2].w * z + data[3].w
+		};
+#endif
+	}
+
+	inline Vector4& Matrix::operator[](int index)
+	{
+		assert(index <= 3 && index >= 0);
+		return data[index];
+	}
+
+	inline Vector4 Matrix::operator[](int index) const
+	{
+		assert(index <= 3 && index >= 0);
+		return data[index];
+	}
+#pragma endregion
 }
\ No newline at end of file
@@ -0,0 +1,222 @@
+#include <chrono>
+#include <type_traits>
+#include "MeshCache.h"
+#include "BVHCache.h"
+#include "CacheFile.h"
+
+namespace dae
+{
+	//Bump whenever the layout below or the layout of a stored type changes, older caches are then rebuilt
+	static constexpr uint32_t MESH_CACHE_VERSION = 3;
+	static constexpr char MESH_CACHE_MAGIC[8] = { 'D', 'A', 'E', 'M', 'E', 'S', 'H', '\0' };
+
+	static_assert(sizeof(Vector3) == 12 && std::is_trivially_copyable_v<Vector3>);
+	static_assert(sizeof(BVHNode) == 32 && std::is_trivially_copyable_v<BVHNode>);
+
+	enum MeshCacheSection : uint32_t
+	{
+		MESH_CACHE_POSITIONS,
+		MESH_CACHE_NORMALS,
+		MESH_CACHE_INDICES,
+		MESH_CACHE_NODES,
+		MESH_CACHE_PRIMITIVE_INDICES,
+		MESH_CACHE_SECTION_COUNT
+	};
+
+	struct MeshCacheHeader final
+	{
+		char magic[8]{};
+		uint32_t version{};
+		uint32_t reserved{};
+		//Size and modification time of the OBJ file the cache was made from
+		uint64_t sourceSize{};
+		int64_t sourceWriteTime{};
+		Vector3 minAABB{};
+		Vector3 maxAABB{};
+		BVHBuildParameters bvhParameters{}; //Of the stored BVH
+		uint32_t counts[MESH_CACHE_SECTION_COUNT]{}; //Elements per section
+		uint32_t padding{};
+		uint64_t offsets[MESH_CACHE_SECTION_COUNT]{}; //Bytes from the start of the file
+	};
+
+	static_assert(std::is_trivially_copyable_v<MeshCacheHeader>);
+
+	static bool GetSourceStamp(const std::string& objFilename, uint64_t& size, int64_t& writeTime)
+	{
+		std::error_code error{};
+		size = std::filesystem::file_size(objFilename, error);
+		if (error)
+			return false;
+
+		const auto lastWriteTime = std::filesystem::last_write_time(objFilename, error);
+		if (error)
+			return false;
+
+		writeTime = static_cast<int64_t>(lastWriteTime.time_since_epoch().count());
+		return true;
+	}
+
+	template<typename T>
+	static bool ReadSection(const MappedFile& file, const MeshCacheHeader& header, MeshCacheSection section, std::vector<T>& values)
+	{
+		return CacheFile::ReadSection(file, header.offsets[section], header.counts[section], values);
+	}
+
+	//Every index has to stay inside its target, so a damaged cache can never make the renderer read out of bounds
+	static bool IsMeshValid(const std::vector<Vector3>& positions, const std::vector<Vector3>& normals, const std::vector<int>& indices)
+	{
+		if (indices.size() % 3 != 0 || normals.size() != indices.size() / 3)
+			return false;
+
+		for (const int index : indices)
+		{
+			if (index < 0 || static_cast<size_t>(index) >= positions.size())
+				return false;
+		}
+		return true;
+	}
+
+	std::string Utils::GetMeshCachePath(const std::string& objFilename)
+	{
+		return objFilename + ".meshcache";
+	}
+
+	bool Utils::LoadOBJMesh(const std::string& filename, TriangleMesh& mesh, OBJLoadReport* pReport)
+	{
+		const auto startTime = std::chrono::steady_clock::now();
+		const std::string cacheFilename = GetMeshCachePath(filename);
+
+		if (LoadMeshCache(cacheFilename, filename, mesh))
+		{
+			if (pReport)
+			{
+				std::error_code error{};
+				*pReport = OBJLoadReport{};
+				pReport->fileSize = static_cast<size_t>(std::filesystem::file_size(cacheFilename, error));
+				pReport->vertexCount = static_cast<uint32_t>(mesh.positions.size());
+				pReport->triangleCount = static_cast<uint32_t>(mesh.indices.size() / 3);
+				pReport->threadCount = 1;
+				pReport->isCached = true;
+				pReport->loadTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+			}
+			return true;
+		}
+
+		if (!LoadOBJ(filename, mesh.positions, mesh.normals, mesh.indices, pReport))
+			return false;
+
+		mesh.UpdateAABB();
+		mesh.bvh.SetLeafBlockWidth(SIMD::GetTriangleBlockWidth());
+		BVHCache::Build(mesh.bvh, mesh.positions, mesh.indices);
+
+		//A cache that can not be written (read-only resources for example) only costs the next load its speed
+		SaveMeshCache(cacheFilename, filename, mesh);
+
+		if (pReport)
+		{
+			pReport->isCached = false;
+			pReport->loadTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		}
+		return true;
+	}
+
+	bool Utils::SaveMeshCache(const std::string& cacheFilename, const std::string& objFilename, const TriangleMesh& mesh)
+	{
+		MeshCacheHeader header{};
+		std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+		header.version = MESH_CACHE_VERSION;
+		header.bvhParameters = mesh.bvh.GetBuildParameters();
+		if (!GetSourceStamp(objFilename, header.sourceSize, header.sourceWriteTime))
+			return false;
+		header.minAABB = mesh.minAABB;
+		header.maxAABB = mesh.maxAABB;
+
+		const std::vector<BVHNode>& nodes = mesh.bvh.GetNodes();
+		const std::vector<uint32_t>& primitiveIndices = mesh.bvh.GetPrimitiveIndices();
+		const uint64_t sectionSizes[MESH_CACHE_SECTION_COUNT] = {
+			mesh.positions.size() * sizeof(Vector3),
+			mesh.normals.size() * sizeof(Vector3),
+			mesh.indices.size() * sizeof(int),
+			nodes.size() * sizeof(BVHNode),
+			primitiveIndices.size() * sizeof(uint32_t)
+		};
+		header.counts[MESH_CACHE_POSITIONS] = static_cast<uint32_t>(mesh.positions.size());
+		header.counts[MESH_CACHE_NORMALS] = static_cast<uint32_t>(mesh.normals.size());
+		header.counts[MESH_CACHE_INDICES] = static_cast<uint32_t>(mesh.indices.size());
+		header.counts[MESH_CACHE_NODES] = static_cast<uint32_t>(nodes.size());
+		header.counts[MESH_CACHE_PRIMITIVE_INDICES] = static_cast<uint32_t>(primitiveIndices.size());
+
+		uint64_t offset = sizeof(MeshCacheHeader);
+		for (uint32_t section = 0; section < MESH_CACHE_SECTION_COUNT; ++section)
+		{
+			header.offsets[section] = CacheFile::AlignSectionOffset(offset);
+			offset = header.offsets[section] + sectionSizes[section];
+		}
+
+		const std::string temporaryFilename = CacheFile::GetTemporaryFilename(cacheFilename);
+		std::ofstream stream{ temporaryFilename, std::ios::binary | std::ios::trunc };
+		if (!stream)
+			return false;
+
+		stream.write(reinterpret_cast<const char*>(&header), sizeof(MeshCacheHeader));
+		uint64_t position = sizeof(MeshCacheHeader);
+		CacheFile::WriteSection(stream, position, header.offsets[MESH_CACHE_POSITIONS], mesh.positions);
+		CacheFile::WriteSection(stream, position, header.offsets[MESH_CACHE_NORMALS], mesh.normals);
+		CacheFile::WriteSection(stream, position, header.offsets[MESH_CACHE_INDICES], mesh.indices);
+		CacheFile::WriteSection(stream, position, header.offsets[MESH_CACHE_NODES], nodes);
+		CacheFile::WriteSection(stream, position, header.offsets[MESH_CACHE_PRIMITIVE_INDICES], primitiveIndices);
+		return CacheFile::Commit(stream, temporaryFilename, cacheFilename);
+	}
+
+	bool Utils::LoadMeshCache(const std::string& cacheFilename, const std::string& objFilename, TriangleMesh& mesh)
+	{
+		MappedFile file{};
+		if (!file.Open(cacheFilename) || file.GetSize() < sizeof(MeshCacheHeader))
+			return false;
+
+		MeshCacheHeader header{};
+		std::memcpy(&header, file.GetData(), sizeof(MeshCacheHeader));
+		if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != MESH_CACHE_VERSION)
+			return false;
+
+		uint64_t sourceSize{};
+		int64_t sourceWriteTime{};
+		if (!GetSourceStamp(objFilename, sourceSize, sourceWriteTime)
+			|| sourceSize != header.sourceSize || sourceWriteTime != header.sourceWriteTime)
+		{
+			return false;
+		}
+
+		//Read into locals first, so a failure leaves the mesh as it was
+		std::vector<Vector3> positions{};
+		std::vector<Vector3> normals{};
+		std::vector<int> indices{};
+		if (!ReadSection(file, header, MESH_CACHE_POSITIONS, positions)
+			|| !ReadSection(file, header, MESH_CACHE_NORMALS, normals)
+			|| !ReadSection(file, header, MESH_CACHE_INDICES, indices)
+			|| !IsMeshValid(positions, normals, indices))
+		{
+			return false;
+		}
+
+		std::vector<BVHNode> nodes{};
+		std::vector<uint32_t> primitiveIndices{};
+		mesh.bvh.SetLeafBlockWidth(SIMD::GetTriangleBlockWidth());
+		const BVHBuildParameters bvhParameters = mesh.bvh.GetBuildParameters();
+		const bool isBVHUsable = std::memcmp(&header.bvhParameters, &bvhParameters, sizeof(BVHBuildParameters)) == 0
+			&& ReadSection(file, header, MESH_CACHE_NODES, nodes)
+			&& ReadSection(file, header, MESH_CACHE_PRIMITIVE_INDICES, primitiveIndices);
+		const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+		mesh.positions = std::move(positions);
+		mesh.normals = std::move(normals);
+		mesh.indices = std::move(indices);
+		mesh.minAABB = header.minAABB;
+		mesh.maxAABB = header.maxAABB;
+
+		//An invalid tree leaves the BVH empty, UpdateTransforms then builds it
+		if (!isBVHUsable || !mesh.bvh.Assign(std::move(nodes), std::move(primitiveIndices), triangleCount))
+			mesh.bvh.Clear();
+		return true;
+	}
+}
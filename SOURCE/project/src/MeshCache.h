@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include "DataTypes.h"
+#include "OBJLoader.h"
+
+namespace dae
+{
+	namespace Utils
+	{
+		//Path of the binary cache LoadOBJMesh keeps next to an OBJ file
+		std::string GetMeshCachePath(const std::string& objFilename);
+
+		//Loads an OBJ file into the positions, normals, indices and object space bounds of a mesh, together with a BVH built
+		//over the untransformed positions. The first load parses the OBJ and writes a binary cache next to it, later loads
+		//map the cache and copy every section out in one go. A cache whose source file changed size or modification time,
+		//that was written by another format version or that fails validation is rebuilt from the OBJ.
+		//The BVH is only taken from the cache when its leaf block width matches this CPU, otherwise UpdateTransforms builds it.
+		bool LoadOBJMesh(const std::string& filename, TriangleMesh& mesh, OBJLoadReport* pReport = nullptr);
+
+		//Writes the geometry, bounds and BVH of a mesh to a cache file tagged with its OBJ source, replacing an older cache
+		//only once the new one is complete
+		bool SaveMeshCache(const std::string& cacheFilename, const std::string& objFilename, const TriangleMesh& mesh);
+
+		//Reads a cache written by SaveMeshCache for the same, unchanged OBJ source into mesh.
+		//Returns false and leaves the mesh untouched when the cache is missing, stale or invalid.
+		bool LoadMeshCache(const std::string& cacheFilename, const std::string& objFilename, TriangleMesh& mesh);
+	}
+}
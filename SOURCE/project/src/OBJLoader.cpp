@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include "OBJLoader.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+namespace dae
+{
+	//Lines are parsed in chunks of about this size, large enough to amortize handing them to a thread and small enough
+	//to balance the load on big files
+	static constexpr size_t OBJ_CHUNK_SIZE = 4 * 1024 * 1024;
+
+	static ThreadPool* g_pLoadThreadPool{};
+
+	//Everything one chunk of lines contains, parsed independently of the other chunks
+	struct OBJChunk final
+	{
+		const char* pBegin{};
+		const char* pEnd{};
+
+		std::vector<Vector3> positions{};
+		//Triangulated corners. Positive OBJ indices are stored 0-based, negative ones are resolved against the
+		//chunk's own vertices and still miss the vertex count of every chunk before it.
+		std::vector<int> indices{};
+		//Positions in indices of the corners that were negative in the file
+		std::vector<uint32_t> relativeCorners{};
+		uint32_t polygonCount{};
+		bool isValid{ true };
+
+		//Where the chunk's vertices and corners start in the merged vectors
+		uint32_t vertexOffset{};
+		size_t indexOffset{};
+	};
+
+	struct OBJCorner final
+	{
+		int index{};
+		bool isRelative{};
+	};
+
+	static bool IsSpace(char character)
+	{
+		return character == ' ' || character == '\t' || character == '\r';
+	}
+
+	static const char* SkipSpaces(const char* pText, const char* pLineEnd)
+	{
+		while (pText < pLineEnd && IsSpace(*pText))
+			++pText;
+		return pText;
+	}
+
+	//Start of the next line, or pEnd for the last one
+	static const char* FindNextLine(const char* pText, const char* pEnd)
+	{
+		const void* pNewLine = std::memchr(pText, '\n', static_cast<size_t>(pEnd - pText));
+		return pNewLine ? static_cast<const char*>(pNewLine) + 1 : pEnd;
+	}
+
+	//Returns the end of the number, or nullptr when there is none
+	static const char* ParseFloat(const char* pText, const char* pLineEnd, float& value)
+	{
+		pText = SkipSpaces(pText, pLineEnd);
+		//from_chars does not accept an explicit plus sign
+		if (pText < pLineEnd && *pText == '+')
+			++pText;
+
+		const auto result = std::from_chars(pText, pLineEnd, value);
+		return result.ec == std::errc{} ? result.ptr : nullptr;
+	}
+
+	//v x y z [w], the optional w is ignored
+	static void ParseVertex(const char* pText, const char* pLineEnd, OBJChunk& chunk)
+	{
+		Vector3 position{};
+		if (!(pText = ParseFloat(pText, pLineEnd, position.x)) ||
+			!(pText = ParseFloat(pText, pLineEnd, position.y)) ||
+			!ParseFloat(pText, pLineEnd, position.z))
+		{
+			chunk.isValid = false;
+			return;
+		}
+		chunk.positions.push_back(position);
+	}
+
+	//f v1[/vt1][/vn1] v2... with any number of corners, triangulated as a fan around the first one
+	static void ParseFace(const char* pText, const char* pLineEnd, OBJChunk& chunk)
+	{
+		const auto addCorner = [&chunk](const OBJCorner& corner)
+			{
+				if (corner.isRelative)
+					chunk.relativeCorners.push_back(static_cast<uint32_t>(chunk.indices.size()));
+				chunk.indices.push_back(corner.index);
+			};
+
+		OBJCorner firstCorner{};
+		OBJCorner previousCorner{};
+		uint32_t cornerCount = 0;
+		while (true)
+		{
+			pText = SkipSpaces(pText, pLineEnd);
+			if (pText == pLineEnd || *pText == '#')
+				break;
+
+			int index{};
+			const auto result = std::from_chars(pText, pLineEnd, index);
+			if (result.ec != std::errc{} || index == 0)
+			{
+				chunk.isValid = false;
+				return;
+			}
+
+			//Only the position index is used, skip the texture coordinate and normal indices
+			pText = result.ptr;
+			while (pText < pLineEnd && !IsSpace(*pText))
+				++pText;
+
+			const OBJCorner corner = index > 0
+				? OBJCorner{ index - 1, false }
+				: OBJCorner{ static_cast<int>(chunk.positions.size()) + index, true };
+
+			if (cornerCount == 0)
+			{
+				firstCorner = corner;
+			}
+			else if (cornerCount >= 2)
+			{
+				addCorner(firstCorner);
+				addCorner(previousCorner);
+				addCorner(corner);
+			}
+			previousCorner = corner;
+			++cornerCount;
+		}
+
+		if (cornerCount > 3)
+			++chunk.polygonCount;
+	}
+
+	static void ParseChunk(OBJChunk& chunk)
+	{
+		const char* pText = chunk.pBegin;
+		while (pText < chunk.pEnd && chunk.isValid)
+		{
+			const char* pNextLine = FindNextLine(pText, chunk.pEnd);
+			const char* pLineEnd = (pNextLine > pText && pNextLine[-1] == '\n') ? pNextLine - 1 : pNextLine;
+
+			pText = SkipSpaces(pText, pLineEnd);
+			//Only "v " and "f " lines matter, vt, vn, comments, groups and material statements are skipped
+			if (pLineEnd - pText >= 2 && IsSpace(pText[1]))
+			{
+				if (pText[0] == 'v')
+					ParseVertex(pText + 2, pLineEnd, chunk);
+				else if (pText[0] == 'f')
+					ParseFace(pText + 2, pLineEnd, chunk);
+			}
+			pText = pNextLine;
+		}
+	}
+
+	//Resolves the chunk's relative corners, copies it into the merged vectors and checks every index
+	static bool MergeChunk(OBJChunk& chunk, std::vector<Vector3>& positions, std::vector<int>& indices)
+	{
+		for (uint32_t corner : chunk.relativeCorners)
+		{
+			chunk.indices[corner] += static_cast<int>(chunk.vertexOffset);
+		}
+
+		const int vertexCount = static_cast<int>(positions.size());
+		const bool areIndicesValid = std::all_of(chunk.indices.begin(), chunk.indices.end(), [vertexCount](int index)
+			{
+				return index >= 0 && index < vertexCount;
+			});
+
+		std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.vertexOffset);
+		std::copy(chunk.indices.begin(), chunk.indices.end(), indices.begin() + chunk.indexOffset);
+
+		//Release the chunk's copies early, on big files they are as large as the result
+		chunk.positions = {};
+		chunk.indices = {};
+		return areIndicesValid;
+	}
+
+	void Utils::SetOBJThreadPool(ThreadPool* pThreadPool)
+	{
+		g_pLoadThreadPool = pThreadPool;
+	}
+
+	bool Utils::LoadOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals,
+		std::vector<int>& indices, OBJLoadReport* pReport)
+	{
+		const auto startTime = std::chrono::steady_clock::now();
+
+		MappedFile file{};
+		if (!file.Open(filename))
+			return false;
+
+		//Split at line ends, so every chunk parses on its own
+		const char* pData = file.GetData();
+		const char* pDataEnd = pData + file.GetSize();
+		std::vector<OBJChunk> chunks{};
+		chunks.reserve(file.GetSize() / OBJ_CHUNK_SIZE + 1);
+		for (const char* pChunkBegin = pData; pChunkBegin < pDataEnd;)
+		{
+			const char* pChunkEnd = pDataEnd;
+			if (static_cast<size_t>(pDataEnd - pChunkBegin) > OBJ_CHUNK_SIZE)
+				pChunkEnd = FindNextLine(pChunkBegin + OBJ_CHUNK_SIZE, pDataEnd);
+
+			OBJChunk& chunk = chunks.emplace_back();
+			chunk.pBegin = pChunkBegin;
+			chunk.pEnd = pChunkEnd;
+			pChunkBegin = pChunkEnd;
+		}
+		const uint32_t chunkCount = static_cast<uint32_t>(chunks.size());
+
+		//Single chunk files have nothing to hand out
+		ThreadPool* pThreadPool = chunkCount > 1 && g_pLoadThreadPool && g_pLoadThreadPool->GetThreadCount() > 1 ? g_pLoadThreadPool : nullptr;
+
+		const auto forEachChunk = [&](const std::function<void(uint32_t)>& task)
+			{
+				if (pThreadPool)
+				{
+					pThreadPool->ParallelFor(chunkCount, task);
+					return;
+				}
+				for (uint32_t chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex)
+				{
+					task(chunkIndex);
+				}
+			};
+
+		forEachChunk([&chunks](uint32_t chunkIndex)
+			{
+				ParseChunk(chunks[chunkIndex]);
+			});
+
+		//Every chunk's vertices and corners follow those of the chunks before it
+		uint32_t vertexCount = 0;
+		size_t indexCount = 0;
+		uint32_t polygonCount = 0;
+		for (OBJChunk& chunk : chunks)
+		{
+			if (!chunk.isValid)
+				return false;
+
+			chunk.vertexOffset = vertexCount;
+			chunk.indexOffset = indexCount;
+			vertexCount += static_cast<uint32_t>(chunk.positions.size());
+			indexCount += chunk.indices.size();
+			polygonCount += chunk.polygonCount;
+		}
+
+		positions.resize(vertexCount);
+		indices.resize(indexCount);
+		std::vector<char> areChunksValid(chunkCount, 0);
+		forEachChunk([&](uint32_t chunkIndex)
+			{
+				areChunksValid[chunkIndex] = MergeChunk(chunks[chunkIndex], positions, indices);
+			});
+		if (std::find(areChunksValid.begin(), areChunksValid.end(), 0) != areChunksValid.end())
+			return false;
+
+		//One geometric normal per triangle, computed over the same chunk split
+		normals.resize(indexCount / 3);
+		forEachChunk([&](uint32_t chunkIndex)
+			{
+				const OBJChunk& chunk = chunks[chunkIndex];
+				const size_t indexEnd = chunkIndex + 1 < chunkCount ? chunks[chunkIndex + 1].indexOffset : indexCount;
+				for (size_t index = chunk.indexOffset; index < indexEnd; index += 3)
+				{
+					const Vector3& v0 = positions[indices[index]];
+					Vector3 normal = Vector3::Cross(positions[indices[index + 1]] - v0, positions[indices[index + 2]] - v0);
+					normal.Normalize();
+					normals[index / 3] = normal;
+				}
+			});
+
+		if (pReport)
+		{
+			pReport->fileSize = file.GetSize();
+			pReport->vertexCount = vertexCount;
+			pReport->triangleCount = static_cast<uint32_t>(indexCount / 3);
+			pReport->polygonCount = polygonCount;
+			pReport->chunkCount = chunkCount;
+			pReport->threadCount = pThreadPool ? pThreadPool->GetThreadCount() : 1;
+			pReport->loadTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		}
+		return true;
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Math.h"
+
+namespace dae
+{
+	class ThreadPool;
+
+	//What a LoadOBJ call read and how long it took
+	struct OBJLoadReport final
+	{
+		size_t fileSize{};
+		uint32_t vertexCount{};
+		uint32_t triangleCount{};
+		uint32_t polygonCount{}; //Faces with more than three corners, fan triangulated
+		uint32_t chunkCount{};
+		uint32_t threadCount{};
+		double loadTime{}; //Seconds, from opening the file until the face normals are done
+		bool isCached{}; //Set by LoadOBJMesh when the mesh came from its binary cache instead of the OBJ text
+	};
+
+	namespace Utils
+	{
+		//Loads the vertex positions and faces of an OBJ file, replacing the contents of the output vectors.
+		//Faces can use the v, v/vt, v//vn and v/vt/vn corner forms and negative (relative) indices, polygons are fan
+		//triangulated. Texture coordinates and file normals are skipped, normals receives one face normal per triangle.
+		//The file is memory mapped and files larger than one chunk are parsed on the pool set with SetOBJThreadPool.
+		//Returns false when the file can not be read, a vertex is malformed or a face index is out of range.
+		bool LoadOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals,
+			std::vector<int>& indices, OBJLoadReport* pReport = nullptr);
+
+		//Pool LoadOBJ parses chunks on, null (the default) parses on the calling thread. The pool has to outlive every
+		//load, and loads must not be started from inside one of its tasks.
+		void SetOBJThreadPool(ThreadPool* pThreadPool);
+	}
+}
@@ -0,0 +1,425 @@
+#include <algorithm>
+#include <bit>
+#include "RayPacket.h"
+#include "SIMD.h"
+
+#if defined(DAE_SIMD_X86)
+#include <immintrin.h>
+#endif
+
+namespace dae
+{
+#pragma region RayPacket
+	void RayPacket::SetRay(uint32_t index, const Ray& ray)
+	{
+		originX[index] = ray.origin.x;
+		originY[index] = ray.origin.y;
+		originZ[index] = ray.origin.z;
+		directionX[index] = ray.direction.x;
+		directionY[index] = ray.direction.y;
+		directionZ[index] = ray.direction.z;
+		min[index] = ray.min;
+		max[index] = ray.max;
+	}
+
+	Ray RayPacket::GetRay(uint32_t index) const
+	{
+		return Ray{
+			{ originX[index], originY[index], originZ[index] },
+			{ directionX[index], directionY[index], directionZ[index] },
+			min[index],
+			max[index]
+		};
+	}
+
+	void RayPacket::Finalize()
+	{
+		minOrigin = { FLT_MAX, FLT_MAX, FLT_MAX };
+		maxOrigin = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		minInverse = { FLT_MAX, FLT_MAX, FLT_MAX };
+		maxInverse = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		minDistance = FLT_MAX;
+
+		//Axes along which every ray so far points the positive or the negative way
+		uint32_t positiveAxes = 0b111;
+		uint32_t negativeAxes = 0b111;
+		for (uint32_t i = 0; i < rayCount; ++i)
+		{
+			inverseX[i] = 1.f / directionX[i];
+			inverseY[i] = 1.f / directionY[i];
+			inverseZ[i] = 1.f / directionZ[i];
+
+			const Vector3 origin{ originX[i], originY[i], originZ[i] };
+			const Vector3 inverse{ inverseX[i], inverseY[i], inverseZ[i] };
+			minOrigin = Vector3::Min(minOrigin, origin);
+			maxOrigin = Vector3::Max(maxOrigin, origin);
+			minInverse = Vector3::Min(minInverse, inverse);
+			maxInverse = Vector3::Max(maxInverse, inverse);
+			minDistance = std::min(minDistance, min[i]);
+
+			positiveAxes &= (directionX[i] > 0.f) | (directionY[i] > 0.f) << 1 | (directionZ[i] > 0.f) << 2;
+			negativeAxes &= (directionX[i] < 0.f) | (directionY[i] < 0.f) << 1 | (directionZ[i] < 0.f) << 2;
+		}
+
+		//Zero components count as neither, so their infinite inverse keeps the packet incoherent
+		isCoherent = rayCount > 0 && (positiveAxes | negativeAxes) == 0b111;
+	}
+
+	void RayPacket::Transform(const RayPacket& packet, const Matrix& transform)
+	{
+		rayCount = packet.rayCount;
+		for (uint32_t i = 0; i < rayCount; ++i)
+		{
+			const Vector3 origin = transform.TransformPoint(packet.originX[i], packet.originY[i], packet.originZ[i]);
+			const Vector3 direction = transform.TransformVector(packet.directionX[i], packet.directionY[i], packet.directionZ[i]);
+			SetRay(i, Ray{ origin, direction, packet.min[i], packet.max[i] });
+		}
+		Finalize();
+	}
+#pragma endregion
+
+	namespace GeometryUtils
+	{
+		//Bounds of [a, b] * [c, d]
+		static void MultiplyInterval(float a, float b, float c, float d, float& lower, float& upper)
+		{
+			const float ac = a * c;
+			const float ad = a * d;
+			const float bc = b * c;
+			const float bd = b * d;
+			lower = std::min(std::min(ac, ad), std::min(bc, bd));
+			upper = std::max(std::max(ac, ad), std::max(bc, bd));
+		}
+
+		bool IntervalTest_RayPacket(const BVHNode& node, const RayPacket& packet)
+		{
+			if (!packet.isCoherent)
+				return true;
+
+			const float boundsMin[3]{ node.minAABB.x, node.minAABB.y, node.minAABB.z };
+			const float boundsMax[3]{ node.maxAABB.x, node.maxAABB.y, node.maxAABB.z };
+			const float originMin[3]{ packet.minOrigin.x, packet.minOrigin.y, packet.minOrigin.z };
+			const float originMax[3]{ packet.maxOrigin.x, packet.maxOrigin.y, packet.maxOrigin.z };
+			const float inverseMin[3]{ packet.minInverse.x, packet.minInverse.y, packet.minInverse.z };
+			const float inverseMax[3]{ packet.maxInverse.x, packet.maxInverse.y, packet.maxInverse.z };
+
+			//Lower bound of every ray's entry distance and upper bound of every ray's exit distance
+			float entry = -FLT_MAX;
+			float exit = FLT_MAX;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				//All rays share the direction sign, so they all enter through the same slab plane
+				const bool isPositive = inverseMin[axis] > 0.f;
+				const float nearPlane = isPositive ? boundsMin[axis] : boundsMax[axis];
+				const float farPlane = isPositive ? boundsMax[axis] : boundsMin[axis];
+
+				float nearLower, nearUpper, farLower, farUpper;
+				MultiplyInterval(nearPlane - originMax[axis], nearPlane - originMin[axis], inverseMin[axis], inverseMax[axis], nearLower, nearUpper);
+				MultiplyInterval(farPlane - originMax[axis], farPlane - originMin[axis], inverseMin[axis], inverseMax[axis], farLower, farUpper);
+
+				entry = std::max(entry, nearLower);
+				exit = std::min(exit, farUpper);
+			}
+			return entry <= exit && exit >= packet.minDistance;
+		}
+
+#if defined(DAE_SIMD_X86)
+#pragma region SSE
+		static uint64_t SlabTest_RayPacketSSE(const BVHNode& node, const RayPacket& packet, uint64_t rayMask)
+		{
+			const __m128 minX = _mm_set1_ps(node.minAABB.x);
+			const __m128 minY = _mm_set1_ps(node.minAABB.y);
+			const __m128 minZ = _mm_set1_ps(node.minAABB.z);
+			const __m128 maxX = _mm_set1_ps(node.maxAABB.x);
+			const __m128 maxY = _mm_set1_ps(node.maxAABB.y);
+			const __m128 maxZ = _mm_set1_ps(node.maxAABB.z);
+
+			uint64_t hitMask = 0;
+			while (rayMask != 0)
+			{
+				//Groups of 4 rays with at least one of them active
+				const uint32_t first = std::countr_zero(rayMask) & ~3u;
+				const uint64_t laneMask = (rayMask >> first) & 0xF;
+				rayMask &= ~(0xFull << first);
+
+				const __m128 originX = _mm_load_ps(packet.originX + first);
+				const __m128 originY = _mm_load_ps(packet.originY + first);
+				const __m128 originZ = _mm_load_ps(packet.originZ + first);
+				const __m128 inverseX = _mm_load_ps(packet.inverseX + first);
+				const __m128 inverseY = _mm_load_ps(packet.inverseY + first);
+				const __m128 inverseZ = _mm_load_ps(packet.inverseZ + first);
+
+				const __m128 tx1 = _mm_mul_ps(_mm_sub_ps(minX, originX), inverseX);
+				const __m128 tx2 = _mm_mul_ps(_mm_sub_ps(maxX, originX), inverseX);
+				const __m128 ty1 = _mm_mul_ps(_mm_sub_ps(minY, originY), inverseY);
+				const __m128 ty2 = _mm_mul_ps(_mm_sub_ps(maxY, originY), inverseY);
+				const __m128 tz1 = _mm_mul_ps(_mm_sub_ps(minZ, originZ), inverseZ);
+				const __m128 tz2 = _mm_mul_ps(_mm_sub_ps(maxZ, originZ), inverseZ);
+
+				__m128 tmin = _mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2));
+				tmin = _mm_max_ps(tmin, _mm_min_ps(tz1, tz2));
+				__m128 tmax = _mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2));
+				tmax = _mm_min_ps(tmax, _mm_max_ps(tz1, tz2));
+
+				const __m128 hit = _mm_and_ps(_mm_cmple_ps(tmin, tmax),
+					_mm_and_ps(_mm_cmpge_ps(tmax, _mm_load_ps(packet.min + first)), _mm_cmple_ps(tmin, _mm_load_ps(packet.max + first))));
+				hitMask |= (static_cast<uint64_t>(_mm_movemask_ps(hit)) & laneMask) << first;
+			}
+			return hitMask;
+		}
+
+		static uint64_t IntersectTriangle_RayPacketSSE(const TriangleRecord& triangle, RayPacket& packet, uint64_t rayMask)
+		{
+			const __m128 v0x = _mm_set1_ps(triangle.v0.x);
+			const __m128 v0y = _mm_set1_ps(triangle.v0.y);
+			const __m128 v0z = _mm_set1_ps(triangle.v0.z);
+			const __m128 edge1x = _mm_set1_ps(triangle.edge1.x);
+			const __m128 edge1y = _mm_set1_ps(triangle.edge1.y);
+			const __m128 edge1z = _mm_set1_ps(triangle.edge1.z);
+			const __m128 edge2x = _mm_set1_ps(triangle.edge2.x);
+			const __m128 edge2y = _mm_set1_ps(triangle.edge2.y);
+			const __m128 edge2z = _mm_set1_ps(triangle.edge2.z);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one = _mm_set1_ps(1.f);
+
+			uint64_t hitMask = 0;
+			while (rayMask != 0)
+			{
+				const uint32_t first = std::countr_zero(rayMask) & ~3u;
+				const uint64_t laneMask = (rayMask >> first) & 0xF;
+				rayMask &= ~(0xFull << first);
+
+				const __m128 dx = _mm_load_ps(packet.directionX + first);
+				const __m128 dy = _mm_load_ps(packet.directionY + first);
+				const __m128 dz = _mm_load_ps(packet.directionZ + first);
+
+				//p = direction x edge2
+				const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, edge2z), _mm_mul_ps(dz, edge2y));
+				const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, edge2x), _mm_mul_ps(dx, edge2z));
+				const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, edge2y), _mm_mul_ps(dy, edge2x));
+
+				const __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1x, px), _mm_mul_ps(edge1y, py)), _mm_mul_ps(edge1z, pz));
+				const __m128 inverseDeterminant = _mm_div_ps(one, determinant);
+
+				//s = origin - v0
+				const __m128 sx = _mm_sub_ps(_mm_load_ps(packet.originX + first), v0x);
+				const __m128 sy = _mm_sub_ps(_mm_load_ps(packet.originY + first), v0y);
+				const __m128 sz = _mm_sub_ps(_mm_load_ps(packet.originZ + first), v0z);
+
+				//q = s x edge1
+				const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, edge1z), _mm_mul_ps(sz, edge1y));
+				const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, edge1x), _mm_mul_ps(sx, edge1z));
+				const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, edge1y), _mm_mul_ps(sy, edge1x));
+
+				const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDeterminant);
+				const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverseDeterminant);
+				const __m128 distances = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edge2x, qx), _mm_mul_ps(edge2y, qy)), _mm_mul_ps(edge2z, qz)), inverseDeterminant);
+
+				const __m128 rayMax = _mm_load_ps(packet.max + first);
+				__m128 mask = _mm_cmpneq_ps(determinant, zero);
+				mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+				mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+				mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+				mask = _mm_and_ps(mask, _mm_cmpge_ps(distances, _mm_load_ps(packet.min + first)));
+				mask = _mm_and_ps(mask, _mm_cmple_ps(distances, rayMax));
+
+				const uint64_t hitLanes = static_cast<uint64_t>(_mm_movemask_ps(mask)) & laneMask;
+				if (hitLanes == 0)
+					continue;
+
+				//Inactive lanes can hit as well, they must keep their max
+				const __m128 activeLanes = _mm_castsi128_ps(_mm_cmpgt_epi32(
+					_mm_and_si128(_mm_set1_epi32(static_cast<int>(hitLanes)), _mm_setr_epi32(1, 2, 4, 8)), _mm_setzero_si128()));
+				_mm_store_ps(packet.max + first, _mm_or_ps(_mm_and_ps(activeLanes, distances), _mm_andnot_ps(activeLanes, rayMax)));
+				hitMask |= hitLanes << first;
+			}
+			return hitMask;
+		}
+#pragma endregion
+#pragma region AVX2
+		DAE_TARGET_AVX2 static uint64_t SlabTest_RayPacketAVX2(const BVHNode& node, const RayPacket& packet, uint64_t rayMask)
+		{
+			const __m256 minX = _mm256_set1_ps(node.minAABB.x);
+			const __m256 minY = _mm256_set1_ps(node.minAABB.y);
+			const __m256 minZ = _mm256_set1_ps(node.minAABB.z);
+			const __m256 maxX = _mm256_set1_ps(node.maxAABB.x);
+			const __m256 maxY = _mm256_set1_ps(node.maxAABB.y);
+			const __m256 maxZ = _mm256_set1_ps(node.maxAABB.z);
+
+			uint64_t hitMask = 0;
+			while (rayMask != 0)
+			{
+				//Groups of 8 rays with at least one of them active
+				const uint32_t first = std::countr_zero(rayMask) & ~7u;
+				const uint64_t laneMask = (rayMask >> first) & 0xFF;
+				rayMask &= ~(0xFFull << first);
+
+				const __m256 originX = _mm256_load_ps(packet.originX + first);
+				const __m256 originY = _mm256_load_ps(packet.originY + first);
+				const __m256 originZ = _mm256_load_ps(packet.originZ + first);
+				const __m256 inverseX = _mm256_load_ps(packet.inverseX + first);
+				const __m256 inverseY = _mm256_load_ps(packet.inverseY + first);
+				const __m256 inverseZ = _mm256_load_ps(packet.inverseZ + first);
+
+				const __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(minX, originX), inverseX);
+				const __m256 tx2 = _mm256_mul_ps(_mm256_sub_ps(maxX, originX), inverseX);
+				const __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(minY, originY), inverseY);
+				const __m256 ty2 = _mm256_mul_ps(_mm256_sub_ps(maxY, originY), inverseY);
+				const __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(minZ, originZ), inverseZ);
+				const __m256 tz2 = _mm256_mul_ps(_mm256_sub_ps(maxZ, originZ), inverseZ);
+
+				__m256 tmin = _mm256_max_ps(_mm256_min_ps(tx1, tx2), _mm256_min_ps(ty1, ty2));
+				tmin = _mm256_max_ps(tmin, _mm256_min_ps(tz1, tz2));
+				__m256 tmax = _mm256_min_ps(_mm256_max_ps(tx1, tx2), _mm256_max_ps(ty1, ty2));
+				tmax = _mm256_min_ps(tmax, _mm256_max_ps(tz1, tz2));
+
+				const __m256 hit = _mm256_and_ps(_mm256_cmp_ps(tmin, tmax, _CMP_LE_OQ),
+					_mm256_and_ps(_mm256_cmp_ps(tmax, _mm256_load_ps(packet.min + first), _CMP_GE_OQ),
+						_mm256_cmp_ps(tmin, _mm256_load_ps(packet.max + first), _CMP_LE_OQ)));
+				hitMask |= (static_cast<uint64_t>(_mm256_movemask_ps(hit)) & laneMask) << first;
+			}
+			return hitMask;
+		}
+
+		DAE_TARGET_AVX2 static uint64_t IntersectTriangle_RayPacketAVX2(const TriangleRecord& triangle, RayPacket& packet, uint64_t rayMask)
+		{
+			const __m256 v0x = _mm256_set1_ps(triangle.v0.x);
+			const __m256 v0y = _mm256_set1_ps(triangle.v0.y);
+			const __m256 v0z = _mm256_set1_ps(triangle.v0.z);
+			const __m256 edge1x = _mm256_set1_ps(triangle.edge1.x);
+			const __m256 edge1y = _mm256_set1_ps(triangle.edge1.y);
+			const __m256 edge1z = _mm256_set1_ps(triangle.edge1.z);
+			const __m256 edge2x = _mm256_set1_ps(triangle.edge2.x);
+			const __m256 edge2y = _mm256_set1_ps(triangle.edge2.y);
+			const __m256 edge2z = _mm256_set1_ps(triangle.edge2.z);
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 one = _mm256_set1_ps(1.f);
+			const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+
+			uint64_t hitMask = 0;
+			while (rayMask != 0)
+			{
+				const uint32_t first = std::countr_zero(rayMask) & ~7u;
+				const uint64_t laneMask = (rayMask >> first) & 0xFF;
+				rayMask &= ~(0xFFull << first);
+
+				const __m256 dx = _mm256_load_ps(packet.directionX + first);
+				const __m256 dy = _mm256_load_ps(packet.directionY + first);
+				const __m256 dz = _mm256_load_ps(packet.directionZ + first);
+
+				//p = direction x edge2
+				const __m256 px = _mm256_fmsub_ps(dy, edge2z, _mm256_mul_ps(dz, edge2y));
+				const __m256 py = _mm256_fmsub_ps(dz, edge2x, _mm256_mul_ps(dx, edge2z));
+				const __m256 pz = _mm256_fmsub_ps(dx, edge2y, _mm256_mul_ps(dy, edge2x));
+
+				const __m256 determinant = _mm256_fmadd_ps(edge1x, px, _mm256_fmadd_ps(edge1y, py, _mm256_mul_ps(edge1z, pz)));
+				const __m256 inverseDeterminant = _mm256_div_ps(one, determinant);
+
+				//s = origin - v0
+				const __m256 sx = _mm256_sub_ps(_mm256_load_ps(packet.originX + first), v0x);
+				const __m256 sy = _mm256_sub_ps(_mm256_load_ps(packet.originY + first), v0y);
+				const __m256 sz = _mm256_sub_ps(_mm256_load_ps(packet.originZ + first), v0z);
+
+				//q = s x edge1
+				const __m256 qx = _mm256_fmsub_ps(sy, edge1z, _mm256_mul_ps(sz, edge1y));
+				const __m256 qy = _mm256_fmsub_ps(sz, edge1x, _mm256_mul_ps(sx, edge1z));
+				const __m256 qz = _mm256_fmsub_ps(sx, edge1y, _mm256_mul_ps(sy, edge1x));
+
+				const __m256 u = _mm256_mul_ps(_mm256_fmadd_ps(sx, px, _mm256_fmadd_ps(sy, py, _mm256_mul_ps(sz, pz))), inverseDeterminant);
+				const __m256 v = _mm256_mul_ps(_mm256_fmadd_ps(dx, qx, _mm256_fmadd_ps(dy, qy, _mm256_mul_ps(dz, qz))), inverseDeterminant);
+				const __m256 distances = _mm256_mul_ps(_mm256_fmadd_ps(edge2x, qx, _mm256_fmadd_ps(edge2y, qy, _mm256_mul_ps(edge2z, qz))), inverseDeterminant);
+
+				const __m256 rayMax = _mm256_load_ps(packet.max + first);
+				__m256 mask = _mm256_cmp_ps(determinant, zero, _CMP_NEQ_UQ);
+				mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+				mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+				mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+				mask = _mm256_and_ps(mask, _mm256_cmp_ps(distances, _mm256_load_ps(packet.min + first), _CMP_GE_OQ));
+				mask = _mm256_and_ps(mask, _mm256_cmp_ps(distances, rayMax, _CMP_LE_OQ));
+
+				const uint64_t hitLanes = static_cast<uint64_t>(_mm256_movemask_ps(mask)) & laneMask;
+				if (hitLanes == 0)
+					continue;
+
+				//Inactive lanes can hit as well, they must keep their max
+				const __m256 activeLanes = _mm256_castsi256_ps(_mm256_cmpgt_epi32(
+					_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(hitLanes)), laneBits), _mm256_setzero_si256()));
+				_mm256_store_ps(packet.max + first, _mm256_blendv_ps(rayMax, distances, activeLanes));
+				hitMask |= hitLanes << first;
+			}
+			return hitMask;
+		}
+#pragma endregion
+
+		uint64_t SlabTest_RayPacket(const BVHNode& node, const RayPacket& packet, uint64_t rayMask)
+		{
+			if (SIMD::GetInstructionSet() == SIMD::InstructionSet::AVX2)
+				return SlabTest_RayPacketAVX2(node, packet, rayMask);
+			return SlabTest_RayPacketSSE(node, packet, rayMask);
+		}
+
+		uint64_t IntersectTriangle_RayPacket(const TriangleRecord& triangle, RayPacket& packet, uint64_t rayMask)
+		{
+			if (SIMD::GetInstructionSet() == SIMD::InstructionSet::AVX2)
+				return IntersectTriangle_RayPacketAVX2(triangle, packet, rayMask);
+			return IntersectTriangle_RayPacketSSE(triangle, packet, rayMask);
+		}
+#else
+#pragma region Scalar
+		uint64_t SlabTest_RayPacket(const BVHNode& node, const RayPacket& packet, uint64_t rayMask)
+		{
+			uint64_t hitMask = 0;
+			while (rayMask != 0)
+			{
+				const uint32_t i = std::countr_zero(rayMask);
+				rayMask &= rayMask - 1;
+
+				const float tx1 = (node.minAABB.x - packet.originX[i]) * packet.inverseX[i];
+				const float tx2 = (node.maxAABB.x - packet.originX[i]) * packet.inverseX[i];
+				const float ty1 = (node.minAABB.y - packet.originY[i]) * packet.inverseY[i];
+				const float ty2 = (node.maxAABB.y - packet.originY[i]) * packet.inverseY[i];
+				const float tz1 = (node.minAABB.z - packet.originZ[i]) * packet.inverseZ[i];
+				const float tz2 = (node.maxAABB.z - packet.originZ[i]) * packet.inverseZ[i];
+
+				const float tmin = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::min(tz1, tz2));
+				const float tmax = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::max(tz1, tz2));
+				if (tmin <= tmax && tmax >= packet.min[i] && tmin <= packet.max[i])
+					hitMask |= 1ull << i;
+			}
+			return hitMask;
+		}
+
+		uint64_t IntersectTriangle_RayPacket(const TriangleRecord& triangle, RayPacket& packet, uint64_t rayMask)
+		{
+			uint64_t hitMask = 0;
+			while (rayMask != 0)
+			{
+				const uint32_t i = std::countr_zero(rayMask);
+				rayMask &= rayMask - 1;
+
+				const Vector3 origin{ packet.originX[i], packet.originY[i], packet.originZ[i] };
+				const Vector3 direction{ packet.directionX[i], packet.directionY[i], packet.directionZ[i] };
+
+				const Vector3 p = Vector3::Cross(direction, triangle.edge2);
+				const float determinant = Vector3::Dot(triangle.edge1, p);
+				if (determinant == 0.f)
+					continue;
+
+				const float inverseDeterminant = 1.f / determinant;
+				const Vector3 s = origin - triangle.v0;
+				const Vector3 q = Vector3::Cross(s, triangle.edge1);
+				const float u = Vector3::Dot(s, p) * inverseDeterminant;
+				const float v = Vector3::Dot(direction, q) * inverseDeterminant;
+				const float distance = Vector3::Dot(triangle.edge2, q) * inverseDeterminant;
+				if (u >= 0.f && v >= 0.f && u + v <= 1.f && distance >= packet.min[i] && distance <= packet.max[i])
+				{
+					packet.max[i] = distance;
+					hitMask |= 1ull << i;
+				}
+			}
+			return hitMask;
+		}
+#pragma endregion
+#endif
+	}
+}
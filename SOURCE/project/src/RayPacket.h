@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include "Math.h"
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Primary rays of an 8x8 pixel block, traced through the acceleration structures together
+	constexpr uint32_t RAY_PACKET_SIZE = 64;
+
+	//Structure of arrays of up to RAY_PACKET_SIZE rays, so every SIMD lane holds one ray.
+	//Which rays take part in a query is passed along as a bit mask, bit i selects ray i.
+	struct alignas(32) RayPacket final
+	{
+		float originX[RAY_PACKET_SIZE]{};
+		float originY[RAY_PACKET_SIZE]{};
+		float originZ[RAY_PACKET_SIZE]{};
+		float directionX[RAY_PACKET_SIZE]{};
+		float directionY[RAY_PACKET_SIZE]{};
+		float directionZ[RAY_PACKET_SIZE]{};
+		float inverseX[RAY_PACKET_SIZE]{};
+		float inverseY[RAY_PACKET_SIZE]{};
+		float inverseZ[RAY_PACKET_SIZE]{};
+		float min[RAY_PACKET_SIZE]{};
+		float max[RAY_PACKET_SIZE]{}; //Shrinks to the closest hit so far, like Ray::max
+
+		uint32_t rayCount{};
+
+		//Bounds over all rays, only valid when isCoherent.
+		//Interval arithmetic on them culls a node for the whole packet with one test.
+		Vector3 minOrigin{};
+		Vector3 maxOrigin{};
+		Vector3 minInverse{};
+		Vector3 maxInverse{};
+		float minDistance{};
+		//Every ray points the same way along every axis, so the inverse direction bounds do not straddle infinity
+		bool isCoherent{};
+
+		void SetRay(uint32_t index, const Ray& ray);
+		Ray GetRay(uint32_t index) const;
+		uint64_t GetRayMask() const { return rayCount == RAY_PACKET_SIZE ? ~0ull : (1ull << rayCount) - 1; }
+
+		//Call once all rays are set, recomputes the inverse directions and the bounds
+		void Finalize();
+		//Same rays in the space of the given transform. Directions are not renormalized, so distances carry over unchanged.
+		void Transform(const RayPacket& packet, const Matrix& transform);
+	};
+
+	namespace GeometryUtils
+	{
+		//Conservative test of the whole packet against the node, false only when no ray can hit it
+		bool IntervalTest_RayPacket(const BVHNode& node, const RayPacket& packet);
+
+		//Slab test of every ray in rayMask against the node, returns the mask of rays overlapping it within [min, max].
+		//Uses AVX2 lanes when available, SSE otherwise.
+		uint64_t SlabTest_RayPacket(const BVHNode& node, const RayPacket& packet, uint64_t rayMask);
+
+		//Two-sided Möller-Trumbore of every ray in rayMask against the triangle. Rays hitting it closer than their max
+		//get their max shrunk to the hit and are returned in the mask.
+		uint64_t IntersectTriangle_RayPacket(const TriangleRecord& triangle, RayPacket& packet, uint64_t rayMask);
+	}
+}
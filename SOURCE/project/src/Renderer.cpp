@@ -1,7 +1,7 @@
 #define PARALEL_EXECUTION
 
-#include <execution>
 #include <algorithm>
+#include <climits>
 
 //External includes
 #include "SDL.h"
@@ -11,28 +11,134 @@
 #include "Renderer.h"
 #include "Math.h"
 #include "Material.h"
+#include "RayPacket.h"
 #include "Scene.h"
+#include "SIMD.h"
 #include "Utils.h"
 #include <iostream>
 
+#if defined(DAE_SIMD_X86)
+#include <immintrin.h>
+#endif
+
 using namespace dae;
 
-Renderer::Renderer(SDL_Window * pWindow) :
+Renderer::Renderer(SDL_Window * pWindow, uint32_t threadCount, bool pinThreads) :
 	m_pWindow(pWindow),
-	m_pBuffer(SDL_GetWindowSurface(pWindow))
+	m_pBuffer(SDL_GetWindowSurface(pWindow)),
+	m_ThreadPool(threadCount, pinThreads)
 {
 	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
 	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+
+	InitializeColorBuffer();
+	BuildTiles();
+}
+
+Renderer::Renderer(int width, int height, uint32_t threadCount, bool pinThreads) :
+	m_pBuffer(SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888)),
+	m_Width(width),
+	m_Height(height),
+	m_ThreadPool(threadCount, pinThreads)
+{
+	//Fails for resolutions too large to allocate, callers check IsValid
+	if (!m_pBuffer)
+		return;
+
+	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+
+	InitializeColorBuffer();
+	BuildTiles();
+}
+
+Renderer::~Renderer()
+{
+	//A window owns its own surface
+	if (!m_pWindow)
+		SDL_FreeSurface(m_pBuffer);
+}
+
+void Renderer::InitializeColorBuffer()
+{
+	const size_t pixelCount = static_cast<size_t>(m_Width) * m_Height;
+	m_RedBuffer.assign(pixelCount, 0.f);
+	m_GreenBuffer.assign(pixelCount, 0.f);
+	m_BlueBuffer.assign(pixelCount, 0.f);
+
+	m_RedShift = m_pBuffer->format->Rshift;
+	m_GreenShift = m_pBuffer->format->Gshift;
+	m_BlueShift = m_pBuffer->format->Bshift;
+	m_AlphaMask = m_pBuffer->format->Amask;
+}
+
+//Integer hash with good avalanche (lowbias32), decorrelates the jitter of neighbouring pixels and samples
+static uint32_t HashSample(uint32_t value)
+{
+	value ^= value >> 16;
+	value *= 0x7feb352du;
+	value ^= value >> 15;
+	value *= 0x846ca68bu;
+	value ^= value >> 16;
+	return value;
+}
+
+static float ToUnitFloat(uint32_t bits)
+{
+	return static_cast<float>(bits >> 8) * (1.f / 16777216.f);
+}
+
+//Luminance of the colour as it will be displayed, so overexposed highlights do not count as noise
+static float GetDisplayLuminance(const ColorRGB& color)
+{
+	return 0.2126f * std::min(color.r, 1.f) + 0.7152f * std::min(color.g, 1.f) + 0.0722f * std::min(color.b, 1.f);
+}
+
+//Interleaves the bits of x and y
+static uint32_t MortonCode(uint32_t x, uint32_t y)
+{
+	uint32_t code = 0;
+	for (uint32_t bit = 0; bit < 16; ++bit)
+	{
+		code |= ((x >> bit) & 1u) << (2 * bit);
+		code |= ((y >> bit) & 1u) << (2 * bit + 1);
+	}
+	return code;
+}
+
+void Renderer::BuildTiles()
+{
+	const uint32_t tilesX = (m_Width + TILE_SIZE - 1) / TILE_SIZE;
+	const uint32_t tilesY = (m_Height + TILE_SIZE - 1) / TILE_SIZE;
+
+	m_Tiles.clear();
+	m_Tiles.reserve(tilesX * tilesY);
+	for (uint32_t tileY = 0; tileY < tilesY; ++tileY)
+	{
+		for (uint32_t tileX = 0; tileX < tilesX; ++tileX)
+		{
+			m_Tiles.push_back(Tile{
+				tileX * TILE_SIZE,
+				tileY * TILE_SIZE,
+				std::min((tileX + 1) * TILE_SIZE, static_cast<uint32_t>(m_Width)),
+				std::min((tileY + 1) * TILE_SIZE, static_cast<uint32_t>(m_Height)) });
+		}
+	}
+
+	std::sort(m_Tiles.begin(), m_Tiles.end(), [](const Tile& a, const Tile& b)
+		{
+			return MortonCode(a.minX / TILE_SIZE, a.minY / TILE_SIZE) < MortonCode(b.minX / TILE_SIZE, b.minY / TILE_SIZE);
+		});
 }
 
-bool Renderer::SaveBufferToImage() const
+bool Renderer::SaveBufferToImage(const char* pPath) const
 {
-	return SDL_SaveBMP(m_pBuffer, "RayTracing_Buffer.bmp");
+	return SDL_SaveBMP(m_pBuffer, pPath);
 }
 
 void Renderer::ToggleShadow()
 {
 	m_ShadowsEnabled = !m_ShadowsEnabled;
+	m_AccumulatedSampleCount = 0;
 }
 
 void Renderer::SwitchLightingMode()
@@ -54,29 +160,423 @@ void Renderer::SwitchLightingMode()
 	default:
 		break;
 	}
+	m_AccumulatedSampleCount = 0;
+}
+
+void Renderer::SwitchToneMapping()
+{
+	switch (m_ToneMapping)
+	{
+	case ToneMapping::MaxToOne:
+		m_ToneMapping = ToneMapping::Reinhard;
+		break;
+	case ToneMapping::Reinhard:
+		m_ToneMapping = ToneMapping::MaxToOne;
+		break;
+	default:
+		break;
+	}
+}
+
+void Renderer::ToggleGammaCorrection()
+{
+	m_GammaCorrectionEnabled = !m_GammaCorrectionEnabled;
 }
 
-void Renderer::RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin) const
+void Renderer::ToggleProgressiveRendering()
 {
-	auto materials{ pScene->GetMaterials() };
+	m_ProgressiveRenderingEnabled = !m_ProgressiveRenderingEnabled;
+	m_AccumulatedSampleCount = 0;
+}
+
+void Renderer::TogglePacketTracing()
+{
+	m_PacketTracingEnabled = !m_PacketTracingEnabled;
+}
+
+void Renderer::ToggleWavefrontRendering()
+{
+	m_WavefrontRenderingEnabled = !m_WavefrontRenderingEnabled;
+}
+
+void Renderer::SetSupersampling(uint32_t baseSampleCount, uint32_t maxSampleCount, float varianceThreshold)
+{
+	m_MaxSampleCount = std::max(maxSampleCount, 1u);
+	//The variance needs at least two samples
+	m_BaseSampleCount = m_MaxSampleCount > 1 ? std::clamp(baseSampleCount, 2u, m_MaxSampleCount) : 1;
+	m_VarianceThreshold = varianceThreshold;
+	m_AccumulatedSampleCount = 0;
+}
+
+void Renderer::ToggleSupersampling()
+{
+	if (m_MaxSampleCount > 1)
+		SetSupersampling(1, 1, m_VarianceThreshold);
+	else
+		SetSupersampling(DEFAULT_BASE_SAMPLE_COUNT, DEFAULT_MAX_SAMPLE_COUNT, m_VarianceThreshold);
+}
+
+bool Renderer::UpdateViewState(Scene* pScene)
+{
+	//Exact comparisons on purpose, any movement at all invalidates the accumulated samples
+	const auto isSamePoint = [](const Vector3& a, const Vector3& b)
+		{
+			return a.x == b.x && a.y == b.y && a.z == b.z;
+		};
+
+	const Camera& camera = pScene->GetCamera();
+	const bool hasChanged = pScene != m_pLastScene
+		|| pScene->GetChangeCount() != m_LastSceneChangeCount
+		|| !isSamePoint(camera.origin, m_LastCameraOrigin)
+		|| !isSamePoint(camera.forward, m_LastCameraForward)
+		|| camera.fovAngle != m_LastCameraFovAngle;
+
+	m_pLastScene = pScene;
+	m_LastSceneChangeCount = pScene->GetChangeCount();
+	m_LastCameraOrigin = camera.origin;
+	m_LastCameraForward = camera.forward;
+	m_LastCameraFovAngle = camera.fovAngle;
+	return hasChanged;
+}
+
+template<Renderer::LightingMode lightMode, bool shadowsEnabled>
+void Renderer::RenderTile(Scene* pScene, const Tile& tile, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin)
+{
+	//Supersampled pixels jitter many rays each, those are traced pixel by pixel
+	if (m_WavefrontRenderingEnabled && m_MaxSampleCount <= 1)
+	{
+		RenderWavefront<lightMode, shadowsEnabled>(pScene, tile, fov, aspectRatio, cameraToWorld, cameraOrigin);
+		return;
+	}
+
+	if (m_PacketTracingEnabled && m_MaxSampleCount <= 1)
+	{
+		for (uint32_t blockY = tile.minY; blockY < tile.maxY; blockY += PACKET_SIZE)
+		{
+			for (uint32_t blockX = tile.minX; blockX < tile.maxX; blockX += PACKET_SIZE)
+			{
+				const Tile block{ blockX, blockY, std::min(blockX + PACKET_SIZE, tile.maxX), std::min(blockY + PACKET_SIZE, tile.maxY) };
+				RenderPacket<lightMode, shadowsEnabled>(pScene, block, fov, aspectRatio, cameraToWorld, cameraOrigin);
+			}
+		}
+		return;
+	}
+
+	for (uint32_t py = tile.minY; py < tile.maxY; ++py)
+	{
+		for (uint32_t px = tile.minX; px < tile.maxX; ++px)
+		{
+			RenderPixel<lightMode, shadowsEnabled>(pScene, px + py * m_Width, fov, aspectRatio, cameraToWorld, cameraOrigin);
+		}
+	}
+}
+
+template<Renderer::LightingMode lightMode, bool shadowsEnabled>
+void Renderer::RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin)
+{
+	const std::vector<MaterialData>& materials{ pScene->GetMaterialTable() };
 
 	const uint32_t px{ pixelIndex % m_Width };
 	const uint32_t py{ pixelIndex / m_Width };
 
-	float rx{ px + 0.5f };
-	float ry{ py + 0.5f };
-	float cx{ (2 * (rx / float(m_Width)) - 1) * aspectRatio * fov };
-	float cy{ (1 - (2 * (ry / float(m_Height)))) * fov };
-
 	ColorRGB finalColor{};
+	if (m_MaxSampleCount <= 1)
+	{
+		float offsetX, offsetY;
+		GetSampleOffset(pixelIndex, offsetX, offsetY);
+		finalColor = TraceSample<lightMode, shadowsEnabled>(pScene, materials, px + offsetX, py + offsetY, fov, aspectRatio, cameraToWorld, cameraOrigin);
+	}
+	else
+	{
+		//Adaptive supersampling: batches of jittered samples are added until the mean luminance is certain enough.
+		//Flat regions stop after the first batch, edges and highlights keep going up to the maximum.
+		ColorRGB colorSum{};
+		float luminanceSum{};
+		float luminanceSquaredSum{};
+		uint32_t sampleCount{};
+		uint32_t batchEnd{ m_BaseSampleCount };
+
+		//Every accumulated frame continues the pixel's sample sequence instead of repeating it
+		const uint32_t sequenceStart{ m_AccumulatedSampleCount * m_MaxSampleCount };
+		while (true)
+		{
+			for (; sampleCount < batchEnd; ++sampleCount)
+			{
+				const uint32_t hash = HashSample(pixelIndex ^ HashSample(sequenceStart + sampleCount));
+				const ColorRGB sample = TraceSample<lightMode, shadowsEnabled>(pScene, materials, px + ToUnitFloat(hash), py + ToUnitFloat(HashSample(hash)),
+					fov, aspectRatio, cameraToWorld, cameraOrigin);
+
+				const float luminance = GetDisplayLuminance(sample);
+				colorSum += sample;
+				luminanceSum += luminance;
+				luminanceSquaredSum += luminance * luminance;
+			}
+
+			if (sampleCount >= m_MaxSampleCount)
+				break;
+
+			//Unbiased sample variance, divided by the sample count once more for the variance of the mean
+			const float mean = luminanceSum / sampleCount;
+			const float variance = std::max(luminanceSquaredSum / sampleCount - mean * mean, 0.f) * sampleCount / (sampleCount - 1);
+			if (variance / sampleCount <= m_VarianceThreshold)
+				break;
+
+			batchEnd = std::min(sampleCount + m_BaseSampleCount, m_MaxSampleCount);
+		}
+
+		finalColor = colorSum / static_cast<float>(sampleCount);
+	}
+
+	StoreSample(pixelIndex, finalColor);
+}
+
+template<Renderer::LightingMode lightMode, bool shadowsEnabled>
+void Renderer::RenderWavefront(Scene* pScene, const Tile& tile, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin)
+{
+	constexpr uint32_t maxRayCount = TILE_SIZE * TILE_SIZE;
+	const std::vector<MaterialData>& materials{ pScene->GetMaterialTable() };
+
+	//Generate: one camera ray per pixel in row order, so every packet sized run of them covers a compact block
+	uint32_t pixelIndices[maxRayCount];
+	Ray cameraRays[maxRayCount];
+	uint32_t rayCount = 0;
+	for (uint32_t py = tile.minY; py < tile.maxY; ++py)
+	{
+		for (uint32_t px = tile.minX; px < tile.maxX; ++px)
+		{
+			const uint32_t pixelIndex = px + py * m_Width;
+			float offsetX, offsetY;
+			GetSampleOffset(pixelIndex, offsetX, offsetY);
+
+			pixelIndices[rayCount] = pixelIndex;
+			cameraRays[rayCount] = GetCameraRay(px + offsetX, py + offsetY, fov, aspectRatio, cameraToWorld, cameraOrigin);
+			++rayCount;
+		}
+	}
+
+	//Intersect: all camera rays back to back
+	HitRecord closestHits[maxRayCount];
+	if (m_PacketTracingEnabled)
+	{
+		for (uint32_t first = 0; first < rayCount; first += RAY_PACKET_SIZE)
+		{
+			RayPacket packet{};
+			packet.rayCount = std::min(RAY_PACKET_SIZE, rayCount - first);
+			for (uint32_t i = 0; i < packet.rayCount; ++i)
+			{
+				packet.SetRay(i, cameraRays[first + i]);
+			}
+			packet.Finalize();
+			pScene->GetClosestHits(packet, closestHits + first);
+		}
+	}
+	else
+	{
+		for (uint32_t i = 0; i < rayCount; ++i)
+		{
+			pScene->GetClosestHit(cameraRays[i], closestHits[i]);
+		}
+	}
+
+	//Sort: counting sort of the hits by material index, so every material's hits end up next to each other
+	uint32_t materialOffsets[UCHAR_MAX + 2]{};
+	for (uint32_t i = 0; i < rayCount; ++i)
+	{
+		if (closestHits[i].didHit)
+			++materialOffsets[closestHits[i].materialIndex + 1];
+	}
+	for (uint32_t material = 1; material < UCHAR_MAX + 2; ++material)
+	{
+		materialOffsets[material] += materialOffsets[material - 1];
+	}
+
+	const uint32_t hitCount = materialOffsets[UCHAR_MAX + 1];
+	uint16_t sortedRays[maxRayCount];
+	for (uint32_t i = 0; i < rayCount; ++i)
+	{
+		if (closestHits[i].didHit)
+			sortedRays[materialOffsets[closestHits[i].materialIndex]++] = static_cast<uint16_t>(i);
+	}
 
+	//Shade: per light, emit the shadow rays of every hit facing it, trace them as one batch and shade the lit hits material by material.
+	//Lights are added in the same order as in ShadeHit, so the sums come out the same.
+	ColorRGB colors[maxRayCount]{};
+	uint16_t batchRays[maxRayCount];
+	Ray shadowRays[maxRayCount];
+	Vector3 lightDirections[maxRayCount];
+	Vector3 viewDirections[maxRayCount];
+	HitRecord batchHits[maxRayCount];
+	ColorRGB brdfs[maxRayCount];
+	constexpr bool needsBRDF = lightMode == LightingMode::BRDF || lightMode == LightingMode::Combined;
+
+	for (const auto& light : pScene->GetLights())
+	{
+		uint32_t batchSize = 0;
+		for (uint32_t i = 0; i < hitCount; ++i)
+		{
+			const uint16_t rayIndex = sortedRays[i];
+			const HitRecord& closestHit = closestHits[rayIndex];
+
+			Vector3 rayToLight = (light.origin - closestHit.origin);
+			const float length = rayToLight.Normalize();
+			if (Vector3::Dot(closestHit.normal, rayToLight) < 0)
+				continue;
+
+			if constexpr (shadowsEnabled)
+			{
+				Ray& shadowRay = shadowRays[batchSize];
+				shadowRay = Ray{ closestHit.origin + closestHit.normal * 0.001f, rayToLight };
+				shadowRay.min = 0.001f;
+				shadowRay.max = length;
+			}
+
+			lightDirections[batchSize] = rayToLight;
+			batchRays[batchSize] = rayIndex;
+			++batchSize;
+		}
+
+		//Occluded hits drop out of the batch, which keeps it sorted by material
+		if constexpr (shadowsEnabled)
+		{
+			uint32_t litCount = 0;
+			for (uint32_t i = 0; i < batchSize; ++i)
+			{
+				if (pScene->IsOccluded(shadowRays[i]))
+					continue;
+
+				lightDirections[litCount] = lightDirections[i];
+				batchRays[litCount] = batchRays[i];
+				++litCount;
+			}
+			batchSize = litCount;
+		}
+
+		if constexpr (needsBRDF)
+		{
+			for (uint32_t i = 0; i < batchSize; ++i)
+			{
+				batchHits[i] = closestHits[batchRays[i]];
+				viewDirections[i] = -cameraRays[batchRays[i]].direction;
+			}
+
+			for (uint32_t runStart = 0; runStart < batchSize;)
+			{
+				const unsigned char materialIndex = batchHits[runStart].materialIndex;
+				uint32_t runEnd = runStart + 1;
+				while (runEnd < batchSize && batchHits[runEnd].materialIndex == materialIndex)
+				{
+					++runEnd;
+				}
+
+				MaterialUtils::ShadeBatch(materials[materialIndex], batchHits + runStart, lightDirections + runStart, viewDirections + runStart,
+					brdfs + runStart, runEnd - runStart);
+				runStart = runEnd;
+			}
+		}
+
+		for (uint32_t i = 0; i < batchSize; ++i)
+		{
+			colors[batchRays[i]] += GetLightContribution<lightMode>(light, closestHits[batchRays[i]], lightDirections[i], [&]()
+				{
+					return brdfs[i];
+				});
+		}
+	}
+
+	for (uint32_t i = 0; i < rayCount; ++i)
+	{
+		StoreSample(pixelIndices[i], colors[i]);
+	}
+}
+
+template<Renderer::LightingMode lightMode, bool shadowsEnabled>
+void Renderer::RenderPacket(Scene* pScene, const Tile& block, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin)
+{
+	static_assert(PACKET_SIZE * PACKET_SIZE <= RAY_PACKET_SIZE, "A pixel block has to fit in one packet");
+	const std::vector<MaterialData>& materials{ pScene->GetMaterialTable() };
+
+	RayPacket packet{};
+	for (uint32_t py = block.minY; py < block.maxY; ++py)
+	{
+		for (uint32_t px = block.minX; px < block.maxX; ++px)
+		{
+			float offsetX, offsetY;
+			GetSampleOffset(px + py * m_Width, offsetX, offsetY);
+			packet.SetRay(packet.rayCount++, GetCameraRay(px + offsetX, py + offsetY, fov, aspectRatio, cameraToWorld, cameraOrigin));
+		}
+	}
+	packet.Finalize();
+
+	HitRecord closestHits[RAY_PACKET_SIZE];
+	pScene->GetClosestHits(packet, closestHits);
+
+	//Shadow rays start all over the scene, so shading stays per pixel
+	uint32_t rayIndex = 0;
+	for (uint32_t py = block.minY; py < block.maxY; ++py)
+	{
+		for (uint32_t px = block.minX; px < block.maxX; ++px)
+		{
+			const Vector3 rayDirection{ packet.directionX[rayIndex], packet.directionY[rayIndex], packet.directionZ[rayIndex] };
+			StoreSample(px + py * m_Width, ShadeHit<lightMode, shadowsEnabled>(pScene, materials, closestHits[rayIndex], rayDirection));
+			++rayIndex;
+		}
+	}
+}
+
+void Renderer::GetSampleOffset(uint32_t pixelIndex, float& offsetX, float& offsetY) const
+{
+	//The first sample goes through the pixel centre, accumulated ones are jittered over the pixel, which also anti-aliases
+	offsetX = 0.5f;
+	offsetY = 0.5f;
+	if (m_AccumulatedSampleCount > 0)
+	{
+		const uint32_t hash = HashSample(pixelIndex ^ HashSample(m_AccumulatedSampleCount));
+		offsetX = ToUnitFloat(hash);
+		offsetY = ToUnitFloat(HashSample(hash));
+	}
+}
+
+void Renderer::StoreSample(uint32_t pixelIndex, const ColorRGB& color)
+{
+	if (m_AccumulatedSampleCount == 0)
+	{
+		m_RedBuffer[pixelIndex] = color.r;
+		m_GreenBuffer[pixelIndex] = color.g;
+		m_BlueBuffer[pixelIndex] = color.b;
+	}
+	else
+	{
+		m_RedBuffer[pixelIndex] += color.r;
+		m_GreenBuffer[pixelIndex] += color.g;
+		m_BlueBuffer[pixelIndex] += color.b;
+	}
+}
+
+template<Renderer::LightingMode lightMode, bool shadowsEnabled>
+ColorRGB Renderer::TraceSample(Scene* pScene, const std::vector<MaterialData>& materials, float rx, float ry, float fov, float aspectRatio,
+	const Matrix& cameraToWorld, const Vector3& cameraOrigin) const
+{
 	HitRecord closestHit{};
+	const Ray hitRay = GetCameraRay(rx, ry, fov, aspectRatio, cameraToWorld, cameraOrigin);
+	pScene->GetClosestHit(hitRay, closestHit);
+
+	return ShadeHit<lightMode, shadowsEnabled>(pScene, materials, closestHit, hitRay.direction);
+}
+
+Ray Renderer::GetCameraRay(float rx, float ry, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin) const
+{
+	float cx{ (2 * (rx / float(m_Width)) - 1) * aspectRatio * fov };
+	float cy{ (1 - (2 * (ry / float(m_Height)))) * fov };
 
 	Vector3 rayDirCamera = Vector3{ cx, cy, 1 }.Normalized();
 	Vector3 rayDirection = cameraToWorld.TransformVector(rayDirCamera).Normalized();
-	Ray hitRay{ cameraOrigin, rayDirection };
+	return Ray{ cameraOrigin, rayDirection };
+}
 
-	pScene->GetClosestHit(hitRay, closestHit);
+template<Renderer::LightingMode lightMode, bool shadowsEnabled>
+ColorRGB Renderer::ShadeHit(Scene* pScene, const std::vector<MaterialData>& materials, const HitRecord& closestHit, const Vector3& rayDirection) const
+{
+	ColorRGB finalColor{};
 
 	if (closestHit.didHit)
 	{
@@ -90,69 +590,156 @@ void Renderer::RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float
 				continue;
 			}
 
-			Ray shadowRay{ closestHit.origin + closestHit.normal * 0.001f, rayToLight };
-			shadowRay.min = 0.001f;
-			shadowRay.max = length;
-
-			ColorRGB brdf = materials[closestHit.materialIndex]->Shade(closestHit, rayToLight, -rayDirection);
-			ColorRGB radiance = LightUtils::GetRadiance(light, closestHit.origin);
-			float lambertCosineLaw = std::max(0.0f, Vector3::Dot(closestHit.normal, rayToLight));
-			ColorRGB observedArea = ColorRGB{ lambertCosineLaw, lambertCosineLaw, lambertCosineLaw };
-
-			if(m_ShadowsEnabled)
+			if constexpr (shadowsEnabled)
 			{
-				if (!pScene->DoesHit(shadowRay))
-				{
-					switch (m_LightMode)
-					{
-					case dae::Renderer::LightingMode::ObservedArea:
-						finalColor += observedArea;
-						break;
-					case dae::Renderer::LightingMode::Radiance:
-						finalColor += radiance;
-						break;
-					case dae::Renderer::LightingMode::BRDF:
-						finalColor += brdf;
-						break;
-					case dae::Renderer::LightingMode::Combined:
-						finalColor += radiance * (brdf * observedArea);
-						break;
-					default:
-						break;
-					}	
-				}
+				Ray shadowRay{ closestHit.origin + closestHit.normal * 0.001f, rayToLight };
+				shadowRay.min = 0.001f;
+				shadowRay.max = length;
+
+				if (pScene->IsOccluded(shadowRay))
+					continue;
 			}
-			else
-			{
-				switch (m_LightMode)
+
+			finalColor += GetLightContribution<lightMode>(light, closestHit, rayToLight, [&]()
 				{
-				case dae::Renderer::LightingMode::ObservedArea:
-					finalColor += observedArea;
-					break;
-				case dae::Renderer::LightingMode::Radiance:
-					finalColor += radiance;
-					break;
-				case dae::Renderer::LightingMode::BRDF:
-					finalColor += brdf;
-					break;
-				case dae::Renderer::LightingMode::Combined:
-					finalColor += radiance * (brdf * observedArea);
-					break;
-				default:
-					break;
-				}
-			}
+					return MaterialUtils::Shade(materials[closestHit.materialIndex], closestHit, rayToLight, -rayDirection);
+				});
 		}
 	}
-	finalColor.MaxToOne();
 
-	m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-		static_cast<uint8_t>(finalColor.r * 255),
-		static_cast<uint8_t>(finalColor.g * 255),
-		static_cast<uint8_t>(finalColor.b * 255));
+	return finalColor;
+}
+
+template<Renderer::LightingMode lightMode, typename BRDFFunction>
+ColorRGB Renderer::GetLightContribution(const Light& light, const HitRecord& closestHit, const Vector3& rayToLight, const BRDFFunction& getBRDF)
+{
+	const float lambertCosineLaw = std::max(0.0f, Vector3::Dot(closestHit.normal, rayToLight));
+	const ColorRGB observedArea = ColorRGB{ lambertCosineLaw, lambertCosineLaw, lambertCosineLaw };
+
+	if constexpr (lightMode == LightingMode::ObservedArea)
+		return observedArea;
+	else if constexpr (lightMode == LightingMode::Radiance)
+		return LightUtils::GetRadiance(light, closestHit.origin);
+	else if constexpr (lightMode == LightingMode::BRDF)
+		return getBRDF();
+	else
+		return LightUtils::GetRadiance(light, closestHit.origin) * (getBRDF() * observedArea);
+}
+
+Renderer::RenderTileFunction Renderer::GetRenderTileFunction() const
+{
+	switch (m_LightMode)
+	{
+	case LightingMode::ObservedArea:
+		return m_ShadowsEnabled ? &Renderer::RenderTile<LightingMode::ObservedArea, true> : &Renderer::RenderTile<LightingMode::ObservedArea, false>;
+	case LightingMode::Radiance:
+		return m_ShadowsEnabled ? &Renderer::RenderTile<LightingMode::Radiance, true> : &Renderer::RenderTile<LightingMode::Radiance, false>;
+	case LightingMode::BRDF:
+		return m_ShadowsEnabled ? &Renderer::RenderTile<LightingMode::BRDF, true> : &Renderer::RenderTile<LightingMode::BRDF, false>;
+	case LightingMode::Combined:
+	default:
+		return m_ShadowsEnabled ? &Renderer::RenderTile<LightingMode::Combined, true> : &Renderer::RenderTile<LightingMode::Combined, false>;
+	}
 }
 
-void Renderer::Render(Scene* pScene) const
+void Renderer::PresentRow(uint32_t row) const
+{
+	const size_t rowStart = static_cast<size_t>(row) * m_Width;
+	const float* pRed = m_RedBuffer.data() + rowStart;
+	const float* pGreen = m_GreenBuffer.data() + rowStart;
+	const float* pBlue = m_BlueBuffer.data() + rowStart;
+	uint32_t* pPixels = m_pBufferPixels + rowStart;
+
+	//The buffer holds sums of the accumulated samples
+	const float sampleWeight = 1.f / static_cast<float>(std::max(m_AccumulatedSampleCount, 1u));
+
+	uint32_t px = 0;
+#if defined(DAE_SIMD_X86)
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 maxChannel = _mm_set1_ps(255.f);
+	const __m128i redShift = _mm_cvtsi32_si128(static_cast<int>(m_RedShift));
+	const __m128i greenShift = _mm_cvtsi32_si128(static_cast<int>(m_GreenShift));
+	const __m128i blueShift = _mm_cvtsi32_si128(static_cast<int>(m_BlueShift));
+	const __m128i alpha = _mm_set1_epi32(static_cast<int>(m_AlphaMask));
+	const __m128 weight = _mm_set1_ps(sampleWeight);
+
+	for (; px + 4 <= static_cast<uint32_t>(m_Width); px += 4)
+	{
+		__m128 red = _mm_mul_ps(_mm_loadu_ps(pRed + px), weight);
+		__m128 green = _mm_mul_ps(_mm_loadu_ps(pGreen + px), weight);
+		__m128 blue = _mm_mul_ps(_mm_loadu_ps(pBlue + px), weight);
+
+		switch (m_ToneMapping)
+		{
+		case ToneMapping::MaxToOne:
+		{
+			//Dividing by one leaves colours that are already in range untouched, exactly like ColorRGB::MaxToOne
+			const __m128 divisor = _mm_max_ps(_mm_max_ps(red, _mm_max_ps(green, blue)), one);
+			red = _mm_div_ps(red, divisor);
+			green = _mm_div_ps(green, divisor);
+			blue = _mm_div_ps(blue, divisor);
+			break;
+		}
+		case ToneMapping::Reinhard:
+			red = _mm_div_ps(red, _mm_add_ps(red, one));
+			green = _mm_div_ps(green, _mm_add_ps(green, one));
+			blue = _mm_div_ps(blue, _mm_add_ps(blue, one));
+			break;
+		default:
+			break;
+		}
+
+		red = _mm_min_ps(_mm_max_ps(red, zero), one);
+		green = _mm_min_ps(_mm_max_ps(green, zero), one);
+		blue = _mm_min_ps(_mm_max_ps(blue, zero), one);
+
+		if (m_GammaCorrectionEnabled)
+		{
+			red = _mm_sqrt_ps(red);
+			green = _mm_sqrt_ps(green);
+			blue = _mm_sqrt_ps(blue);
+		}
+
+		//Truncating conversion, matching the cast to uint8_t
+		const __m128i redBytes = _mm_cvttps_epi32(_mm_mul_ps(red, maxChannel));
+		const __m128i greenBytes = _mm_cvttps_epi32(_mm_mul_ps(green, maxChannel));
+		const __m128i blueBytes = _mm_cvttps_epi32(_mm_mul_ps(blue, maxChannel));
+
+		__m128i packed = _mm_or_si128(_mm_sll_epi32(redBytes, redShift), _mm_sll_epi32(greenBytes, greenShift));
+		packed = _mm_or_si128(packed, _mm_sll_epi32(blueBytes, blueShift));
+		packed = _mm_or_si128(packed, alpha);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pPixels + px), packed);
+	}
+#endif
+
+	for (; px < static_cast<uint32_t>(m_Width); ++px)
+	{
+		ColorRGB color{ pRed[px] * sampleWeight, pGreen[px] * sampleWeight, pBlue[px] * sampleWeight };
+		switch (m_ToneMapping)
+		{
+		case ToneMapping::MaxToOne:
+			color.MaxToOne();
+			break;
+		case ToneMapping::Reinhard:
+			color = { color.r / (color.r + 1.f), color.g / (color.g + 1.f), color.b / (color.b + 1.f) };
+			break;
+		default:
+			break;
+		}
+
+		color = { std::clamp(color.r, 0.f, 1.f), std::clamp(color.g, 0.f, 1.f), std::clamp(color.b, 0.f, 1.f) };
+		if (m_GammaCorrectionEnabled)
+			color = { std::sqrt(color.r), std::sqrt(color.g), std::sqrt(color.b) };
+
+		pPixels[px] = (static_cast<uint32_t>(color.r * 255) << m_RedShift)
+			| (static_cast<uint32_t>(color.g * 255) << m_GreenShift)
+			| (static_cast<uint32_t>(color.b * 255) << m_BlueShift)
+			| m_AlphaMask;
+	}
+}
+
+void Renderer::Render(Scene* pScene)
 {
 	Camera& camera = pScene->GetCamera();
 	Matrix camToWorld = camera.CalculateCameraToWorld();
@@ -162,34 +749,48 @@ void Renderer::Render(Scene* pScene) const
 	float fovAngle = camera.fovAngle * TO_RADIANS;
 	float fov = tanf(fovAngle * 0.5f);
 
-	int totalPixels = m_Width * m_Height;
+	//Restart accumulating whenever the image would look different
+	if (UpdateViewState(pScene) || !m_ProgressiveRenderingEnabled)
+		m_AccumulatedSampleCount = 0;
+
+	//A converged image is only presented again, so idle frames cost next to nothing
+	const bool needsSample = m_AccumulatedSampleCount < MAX_ACCUMULATED_SAMPLES;
+	const RenderTileFunction renderTile = GetRenderTileFunction();
 
 	#if defined(PARALEL_EXECUTION)
 		// parallel logic
-		uint32_t amountOfPixels{ uint32_t(m_Width * m_Height) };
-		std::vector<uint32_t> pixelIndices{};
-
-		pixelIndices.reserve(amountOfPixels);
-		for (uint32_t index{}; index < amountOfPixels; ++index)
+		if (needsSample)
 		{
-			pixelIndices.emplace_back(index);
+			m_ThreadPool.ParallelFor(static_cast<uint32_t>(m_Tiles.size()), [&](uint32_t tileIndex)
+				{
+					(this->*renderTile)(pScene, m_Tiles[tileIndex], fov, aspectRatio, camToWorld, camera.origin);
+				});
+			++m_AccumulatedSampleCount;
 		}
 
-		std::for_each(std::execution::par, pixelIndices.begin(), pixelIndices.end(), [&](int i)
+		m_ThreadPool.ParallelFor(static_cast<uint32_t>(m_Height), [&](uint32_t row)
 			{
-				RenderPixel(pScene, i, fov, aspectRatio, camToWorld, camera.origin);
+				PresentRow(row);
 			});
 	#else
 		//synchronous logic (no threading)
-		uint32_t amountOfPixels{ uint32_t(m_Width * m_Height) };
-		for (uint32_t pixelIndex{}; pixelIndex < amountOfPixels; ++pixelIndex)
+		if (needsSample)
 		{
-			RenderPixel(pScene, pixelIndex, fov, aspectRatio, camToWorld, camera.origin);
+			for (const Tile& tile : m_Tiles)
+			{
+				(this->*renderTile)(pScene, tile, fov, aspectRatio, camToWorld, camera.origin);
+			}
+			++m_AccumulatedSampleCount;
 		}
 
+		for (uint32_t row{}; row < static_cast<uint32_t>(m_Height); ++row)
+		{
+			PresentRow(row);
+		}
 	#endif
 
 	//@END
 	//Update SDL Surface
-	SDL_UpdateWindowSurface(m_pWindow);
+	if (m_pWindow)
+		SDL_UpdateWindowSurface(m_pWindow);
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 #include <cstdint>
+#include <vector>
 #include "Math.h"
+#include "ThreadPool.h"
 
 struct SDL_Window;
 struct SDL_Surface;
@@ -8,24 +10,57 @@ struct SDL_Surface;
 namespace dae
 {
 	class Scene;
+	struct MaterialData;
+	struct Ray;
+	struct HitRecord;
+	struct Light;
 	class Renderer final
 	{
 	public:
-		Renderer(SDL_Window* pWindow);
-		~Renderer() = default;
+		//threadCount includes the main thread, 0 uses every hardware thread. pinThreads binds every render worker to its own core.
+		Renderer(SDL_Window* pWindow, uint32_t threadCount = 0, bool pinThreads = false);
+		//Headless, renders into an owned in-memory buffer without needing a window or display
+		Renderer(int width, int height, uint32_t threadCount = 0, bool pinThreads = false);
+		~Renderer();
+
+		//False when the headless buffer could not be created, SDL_GetError then says why and the renderer must not be used
+		bool IsValid() const { return m_pBuffer != nullptr; }
 
 		Renderer(const Renderer&) = delete;
 		Renderer(Renderer&&) noexcept = delete;
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
-		void Render(Scene* pScene) const;
-		bool SaveBufferToImage() const;
+		void Render(Scene* pScene);
+		bool SaveBufferToImage(const char* pPath = "RayTracing_Buffer.bmp") const;
 
 		void ToggleShadow();
 		void SwitchLightingMode();
+		void SwitchToneMapping();
+		void ToggleGammaCorrection();
+		void ToggleProgressiveRendering();
+		//Traces the primary rays of 8x8 pixel blocks as packets instead of one by one, the image stays the same
+		void TogglePacketTracing();
+		//Renders tiles as wavefronts: every stage runs over the whole tile before the next one starts, and hits are shaded
+		//grouped by material. The image stays the same.
+		void ToggleWavefrontRendering();
+
+		//Adaptive supersampling: every pixel takes baseSampleCount jittered samples, pixels whose mean luminance still has a
+		//variance above varianceThreshold get more in batches of baseSampleCount, up to maxSampleCount. A maximum of 1 disables it.
+		void SetSupersampling(uint32_t baseSampleCount, uint32_t maxSampleCount, float varianceThreshold = DEFAULT_VARIANCE_THRESHOLD);
+		//Switches between a single sample per pixel and the default adaptive settings
+		void ToggleSupersampling();
+
+		//Render workers, free to use for other work (such as BVH builds) between frames
+		ThreadPool& GetThreadPool() { return m_ThreadPool; }
+
+		static constexpr uint32_t DEFAULT_BASE_SAMPLE_COUNT = 4;
+		static constexpr uint32_t DEFAULT_MAX_SAMPLE_COUNT = 16;
+		//Variance of a pixel's mean luminance, the square of roughly 2.5 display levels
+		static constexpr float DEFAULT_VARIANCE_THRESHOLD = 1e-4f;
 
 	private:
+		//Null for headless renderers, which own m_pBuffer instead
 		SDL_Window* m_pWindow{};
 
 		SDL_Surface* m_pBuffer{};
@@ -34,7 +69,48 @@ namespace dae
 		int m_Width{};
 		int m_Height{};
 
-		void RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin) const;
+		//Linear, unclamped colour of every pixel as one plane per channel, so the display pass can convert several pixels at once
+		std::vector<float> m_RedBuffer{};
+		std::vector<float> m_GreenBuffer{};
+		std::vector<float> m_BlueBuffer{};
+
+		//Progressive refinement: while the camera, scene and render settings stay the same, every frame adds one jittered
+		//sample per pixel to the colour buffer, which then holds sums. Tracing stops once enough samples were taken.
+		static constexpr uint32_t MAX_ACCUMULATED_SAMPLES = 256;
+		uint32_t m_AccumulatedSampleCount{};
+
+		uint32_t m_BaseSampleCount{ 1 };
+		uint32_t m_MaxSampleCount{ 1 };
+		float m_VarianceThreshold{ DEFAULT_VARIANCE_THRESHOLD };
+
+		//What the last frame showed, accumulation restarts as soon as any of it changes
+		const Scene* m_pLastScene{};
+		uint32_t m_LastSceneChangeCount{};
+		Vector3 m_LastCameraOrigin{};
+		Vector3 m_LastCameraForward{};
+		float m_LastCameraFovAngle{};
+
+		//Channel layout of m_pBuffer, read once instead of calling SDL_MapRGB per pixel
+		uint32_t m_RedShift{};
+		uint32_t m_GreenShift{};
+		uint32_t m_BlueShift{};
+		uint32_t m_AlphaMask{};
+
+		//Square screen tiles rendered as one task each, they keep the BVH nodes and framebuffer lines a thread touches hot in cache
+		static constexpr uint32_t TILE_SIZE = 16;
+		struct Tile
+		{
+			uint32_t minX;
+			uint32_t minY;
+			uint32_t maxX;
+			uint32_t maxY;
+		};
+		//Morton ordered, so consecutive tasks cover neighbouring screen regions
+		std::vector<Tile> m_Tiles{};
+		//Side of the pixel blocks whose primary rays are traced as one packet, tiles split into whole packets
+		static constexpr uint32_t PACKET_SIZE = 8;
+
+		ThreadPool m_ThreadPool;
 
 		enum class LightingMode {
 			ObservedArea,
@@ -43,7 +119,55 @@ namespace dae
 			Combined
 		};
 
+		enum class ToneMapping {
+			MaxToOne, //Scales colours down so their largest channel is at most one
+			Reinhard
+		};
+
+		void InitializeColorBuffer();
+		//Compares the view with the last frame's and remembers it, true when accumulated samples no longer match it
+		bool UpdateViewState(Scene* pScene);
+		void BuildTiles();
+		//The lighting mode and shadow toggle are template parameters of the render kernels, so the per light work is
+		//resolved at compile time. Render picks the matching RenderTile instantiation once per frame.
+		using RenderTileFunction = void (Renderer::*)(Scene*, const Tile&, float, float, const Matrix&, const Vector3&);
+		RenderTileFunction GetRenderTileFunction() const;
+
+		template<LightingMode lightMode, bool shadowsEnabled>
+		void RenderTile(Scene* pScene, const Tile& tile, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin);
+		template<LightingMode lightMode, bool shadowsEnabled>
+		void RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin);
+		//Single sample version of RenderTile in stages: generate all camera rays, intersect them, sort the hits by material,
+		//then per light emit and trace all shadow rays and shade the lit hits in one batch per material
+		template<LightingMode lightMode, bool shadowsEnabled>
+		void RenderWavefront(Scene* pScene, const Tile& tile, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin);
+		//Single sample version of RenderPixel for a block of at most PACKET_SIZE x PACKET_SIZE pixels, tracing them as one ray packet
+		template<LightingMode lightMode, bool shadowsEnabled>
+		void RenderPacket(Scene* pScene, const Tile& block, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin);
+		//Shades the camera ray through the screen position (rx, ry), in pixels
+		template<LightingMode lightMode, bool shadowsEnabled>
+		ColorRGB TraceSample(Scene* pScene, const std::vector<MaterialData>& materials, float rx, float ry, float fov, float aspectRatio,
+			const Matrix& cameraToWorld, const Vector3& cameraOrigin) const;
+		Ray GetCameraRay(float rx, float ry, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin) const;
+		//Direct lighting at the closest hit of a view ray, black when it missed
+		template<LightingMode lightMode, bool shadowsEnabled>
+		ColorRGB ShadeHit(Scene* pScene, const std::vector<MaterialData>& materials, const HitRecord& closestHit, const Vector3& rayDirection) const;
+		//What one unoccluded light adds to a hit in the given lighting mode. getBRDF is only called by the modes that show it.
+		template<LightingMode lightMode, typename BRDFFunction>
+		static ColorRGB GetLightContribution(const Light& light, const HitRecord& closestHit, const Vector3& rayToLight, const BRDFFunction& getBRDF);
+		//Where the single sample of a pixel lies within it: the centre, or jittered once samples accumulate
+		void GetSampleOffset(uint32_t pixelIndex, float& offsetX, float& offsetY) const;
+		//Writes the frame's sample, or adds it to the accumulated ones
+		void StoreSample(uint32_t pixelIndex, const ColorRGB& color);
+		//Tone maps, gamma corrects and packs one row of the colour buffer into the display surface
+		void PresentRow(uint32_t row) const;
+
 		LightingMode m_LightMode{ LightingMode::Combined };
+		ToneMapping m_ToneMapping{ ToneMapping::MaxToOne };
 		bool m_ShadowsEnabled{ true };
+		bool m_GammaCorrectionEnabled{ false };
+		bool m_ProgressiveRenderingEnabled{ true };
+		bool m_PacketTracingEnabled{ true };
+		bool m_WavefrontRenderingEnabled{ false };
 	};
 }
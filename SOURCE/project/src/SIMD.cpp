@@ -0,0 +1,72 @@
+#include "SIMD.h"
+
+#if defined(DAE_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace dae
+{
+	namespace SIMD
+	{
+		static InstructionSet DetectInstructionSet()
+		{
+#if !defined(DAE_SIMD_X86)
+			return InstructionSet::Scalar;
+#elif defined(_MSC_VER)
+			int cpuInfo[4]{};
+			__cpuid(cpuInfo, 1);
+			const bool hasOSXSave = (cpuInfo[2] & (1 << 27)) != 0;
+			const bool hasFMA = (cpuInfo[2] & (1 << 12)) != 0;
+
+			__cpuidex(cpuInfo, 7, 0);
+			const bool hasAVX2 = (cpuInfo[1] & (1 << 5)) != 0;
+
+			//The OS has to save the YMM registers on context switches as well
+			const bool hasOSYMMSupport = hasOSXSave && (_xgetbv(0) & 0x6) == 0x6;
+
+			if (hasAVX2 && hasFMA && hasOSYMMSupport)
+				return InstructionSet::AVX2;
+			return InstructionSet::SSE;
+#else
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+				return InstructionSet::AVX2;
+			return InstructionSet::SSE;
+#endif
+		}
+
+		InstructionSet GetInstructionSet()
+		{
+			static const InstructionSet instructionSet = DetectInstructionSet();
+			return instructionSet;
+		}
+
+		int GetTriangleBlockWidth()
+		{
+			switch (GetInstructionSet())
+			{
+			case InstructionSet::AVX2:
+				return 8;
+			case InstructionSet::SSE:
+				return 4;
+			case InstructionSet::Scalar:
+			default:
+				return 1;
+			}
+		}
+
+		int GetBVHNodeWidth()
+		{
+			switch (GetInstructionSet())
+			{
+			case InstructionSet::AVX2:
+				return 8;
+			case InstructionSet::SSE:
+				return 4;
+			case InstructionSet::Scalar:
+			default:
+				return 2;
+			}
+		}
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DAE_SIMD_X86
+#endif
+
+//Lets single functions use AVX2 without compiling the whole translation unit (and the inline code it pulls in) for it.
+//MSVC accepts AVX2 intrinsics anywhere, so it needs no attribute.
+#if defined(DAE_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define DAE_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define DAE_TARGET_AVX2
+#endif
+
+namespace dae
+{
+	namespace SIMD
+	{
+		enum class InstructionSet
+		{
+			Scalar,
+			SSE,
+			AVX2
+		};
+
+		//Widest instruction set both the CPU and OS support, detected once
+		InstructionSet GetInstructionSet();
+
+		//Number of triangles packed per SIMD block for the detected instruction set, 1 means scalar
+		int GetTriangleBlockWidth();
+
+		//Number of children per BVH node one SIMD slab test covers for the detected instruction set, 2 means binary
+		int GetBVHNodeWidth();
+	}
+}
@@ -1,22 +1,37 @@
+#include <iostream>
 #include "Scene.h"
 #include "Utils.h"
 #include "Material.h"
+#include "MeshCache.h"
 
 namespace dae {
 
 #pragma region Base Scene
 	//Initialize Scene with Default Solid Color Material (RED)
-	Scene::Scene() :
-		m_Materials({ new Material_SolidColor({1,0,0}) })
+	Scene::Scene()
 	{
+		AddMaterial(new Material_SolidColor({ 1,0,0 }));
+
+		//The TLAS follows the animation every frame, the --bvh build mode is meant for mesh BVHs
+		m_TLAS.SetBuildMode(BVHBuildMode::SAH);
+
 		m_SphereGeometries.reserve(32);
 		m_PlaneGeometries.reserve(32);
 		m_TriangleMeshGeometries.reserve(32);
+		m_TriangleMeshInstances.reserve(32);
 		m_Lights.reserve(32);
 	}
 
 	Scene::~Scene()
 	{
+		for (auto& pMesh : m_SharedTriangleMeshes)
+		{
+			delete pMesh;
+			pMesh = nullptr;
+		}
+
+		m_SharedTriangleMeshes.clear();
+
 		for (auto& pMaterial : m_Materials)
 		{
 			delete pMaterial;
@@ -24,99 +39,175 @@ namespace dae {
 		}
 
 		m_Materials.clear();
+		m_MaterialTable.clear();
 	}
 
     void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
     {
         closestHit.didHit = false;
-        float closestT = FLT_MAX;
-
-        for (const auto& sphere : m_SphereGeometries)
-        {
-            HitRecord hit{};
-            if (GeometryUtils::HitTest_Sphere(sphere,ray,hit))
-            {
-                if (hit.didHit && hit.t < closestT)
-                {
-                    closestT = hit.t;
-                    closestHit = hit;
-                }
-            }
-        }
-		
+
+		//ray.max shrinks to the closest hit so far, so the TLAS only visits objects that can still be closer
+		Ray localRay{ ray };
+
 		for (const auto& plane : m_PlaneGeometries)
 		{
 			HitRecord hit{};
-			if (GeometryUtils::HitTest_Plane(plane, ray, hit))
+			if (GeometryUtils::HitTest_Plane(plane, localRay, hit))
 			{
-				if (hit.didHit && hit.t < closestT)
+				if (hit.didHit && hit.t < localRay.max)
 				{
-					closestT = hit.t;
+					localRay.max = hit.t;
 					closestHit = hit;
 				}
 			}
 		}
 
-		for (const auto& triangle : m_Triangles) {
-			HitRecord hit{};
-			if (GeometryUtils::HitTest_Triangle(triangle, ray, hit))
+		GeometryUtils::TraverseBVH(m_TLAS, localRay, [&](uint32_t primitiveSlot, Ray& currentRay)
 			{
-				switch (triangle.cullMode) {
-				case TriangleCullMode::BackFaceCulling:
-					if (Vector3::Dot(triangle.normal, ray.direction) > 0)
-						continue;
+				const PrimitiveReference& primitive = m_TLASPrimitives[m_TLAS.GetPrimitiveIndices()[primitiveSlot]];
+				HitRecord hit{};
+				switch (primitive.type)
+				{
+				case PrimitiveType::Sphere:
+					if (!GeometryUtils::HitTest_Sphere(m_SphereGeometries[primitive.index], currentRay, hit))
+						return false;
 					break;
-				case TriangleCullMode::FrontFaceCulling:
-					if (Vector3::Dot(triangle.normal, ray.direction) < 0)
-						continue;
+				case PrimitiveType::Triangle:
+				{
+					const Triangle& triangle = m_Triangles[primitive.index];
+					if (!GeometryUtils::HitTest_Triangle(triangle, currentRay, hit)
+						|| GeometryUtils::IsCulled(triangle.cullMode, triangle.normal, currentRay.direction))
+						return false;
 					break;
-				case TriangleCullMode::NoCulling:
+				}
+				case PrimitiveType::TriangleMesh:
+				{
+					const TriangleMesh& mesh = m_TriangleMeshGeometries[primitive.index];
+					if (!GeometryUtils::HitTest_TriangleMesh(mesh, currentRay, hit)
+						|| GeometryUtils::IsCulled(mesh.cullMode, hit.normal, currentRay.direction))
+						return false;
+					break;
+				}
+				case PrimitiveType::TriangleMeshInstance:
+				{
+					const TriangleMeshInstance& instance = m_TriangleMeshInstances[primitive.index];
+					if (!GeometryUtils::HitTest_TriangleMeshInstance(instance, currentRay, hit)
+						|| GeometryUtils::IsCulled(instance.cullMode, hit.normal, currentRay.direction))
+						return false;
 					break;
 				}
-				if (hit.didHit && hit.t < closestT)
+				}
+
+				if (hit.didHit && hit.t < currentRay.max)
 				{
-					closestT = hit.t;
+					currentRay.max = hit.t;
 					closestHit = hit;
 				}
+				return false;
+			});
+    }
+
+	void Scene::GetClosestHits(const RayPacket& packet, HitRecord* pHitRecords) const
+	{
+		//Rays pointing every which way share too few nodes to be worth tracing together
+		if (!packet.isCoherent)
+		{
+			for (uint32_t i = 0; i < packet.rayCount; ++i)
+			{
+				GetClosestHit(packet.GetRay(i), pHitRecords[i]);
 			}
+			return;
 		}
 
-		for (const auto& mesh : m_TriangleMeshGeometries)
-		{
-			HitRecord hit{};
-			if(GeometryUtils::HitTest_TriangleMesh(mesh, ray, hit))
+		//Every ray's max shrinks to its closest hit so far, like in GetClosestHit
+		RayPacket localPacket{ packet };
+		const auto updateClosestHit = [&](uint32_t rayIndex, const HitRecord& hit)
 			{
-				switch (mesh.cullMode) {
-				case TriangleCullMode::BackFaceCulling:
-					if (Vector3::Dot(hit.normal, ray.direction) > 0)
-						continue;
-					break;
-				case TriangleCullMode::FrontFaceCulling:
-					if (Vector3::Dot(hit.normal, ray.direction) < 0)
-						continue;
-					break;
-				case TriangleCullMode::NoCulling:
-					break;
-				}
-				if (hit.didHit && hit.t < closestT)
+				if (hit.didHit && hit.t < localPacket.max[rayIndex])
 				{
-					closestT = hit.t;
-					closestHit = hit;
+					localPacket.max[rayIndex] = hit.t;
+					pHitRecords[rayIndex] = hit;
 				}
 			};
-		}
-    }
 
-	bool Scene::DoesHit(const Ray& ray) const
-	{
-		for (const auto& sphere : m_SphereGeometries)
+		for (uint32_t i = 0; i < packet.rayCount; ++i)
 		{
-			if (GeometryUtils::HitTest_Sphere(sphere, ray))
-			{ 
-				return true; 
-			}	
+			pHitRecords[i].didHit = false;
+
+			const Ray ray = packet.GetRay(i);
+			for (const auto& plane : m_PlaneGeometries)
+			{
+				HitRecord hit{};
+				if (GeometryUtils::HitTest_Plane(plane, Ray{ ray.origin, ray.direction, ray.min, localPacket.max[i] }, hit))
+					updateClosestHit(i, hit);
+			}
 		}
 
+		GeometryUtils::TraverseBVHLeaves(m_TLAS, localPacket, localPacket.GetRayMask(), [&](const BVHNode& leaf, uint32_t, RayPacket& currentPacket, uint64_t rayMask)
+			{
+				for (uint32_t slot = leaf.leftFirst; slot < leaf.leftFirst + leaf.primitiveCount; ++slot)
+				{
+					const PrimitiveReference& primitive = m_TLASPrimitives[m_TLAS.GetPrimitiveIndices()[slot]];
+					switch (primitive.type)
+					{
+					case PrimitiveType::Sphere:
+					case PrimitiveType::Triangle:
+						//Single primitives have no hierarchy to share, every ray tests them on its own
+						for (uint64_t remaining = rayMask; remaining != 0; remaining &= remaining - 1)
+						{
+							const uint32_t i = std::countr_zero(remaining);
+							const Ray ray = currentPacket.GetRay(i);
+							HitRecord hit{};
+							if (primitive.type == PrimitiveType::Sphere)
+							{
+								if (!GeometryUtils::HitTest_Sphere(m_SphereGeometries[primitive.index], ray, hit))
+									continue;
+							}
+							else
+							{
+								const Triangle& triangle = m_Triangles[primitive.index];
+								if (!GeometryUtils::HitTest_Triangle(triangle, ray, hit)
+									|| GeometryUtils::IsCulled(triangle.cullMode, triangle.normal, ray.direction))
+									continue;
+							}
+							updateClosestHit(i, hit);
+						}
+						break;
+					case PrimitiveType::TriangleMesh:
+					case PrimitiveType::TriangleMeshInstance:
+					{
+						HitRecord hits[RAY_PACKET_SIZE];
+						TriangleCullMode cullMode;
+						uint64_t hitMask;
+						if (primitive.type == PrimitiveType::TriangleMesh)
+						{
+							const TriangleMesh& mesh = m_TriangleMeshGeometries[primitive.index];
+							cullMode = mesh.cullMode;
+							hitMask = GeometryUtils::HitTest_TriangleMesh(mesh, currentPacket, rayMask, hits);
+						}
+						else
+						{
+							const TriangleMeshInstance& instance = m_TriangleMeshInstances[primitive.index];
+							cullMode = instance.cullMode;
+							hitMask = GeometryUtils::HitTest_TriangleMeshInstance(instance, currentPacket, rayMask, hits);
+						}
+
+						for (; hitMask != 0; hitMask &= hitMask - 1)
+						{
+							const uint32_t i = std::countr_zero(hitMask);
+							const Vector3 direction{ currentPacket.directionX[i], currentPacket.directionY[i], currentPacket.directionZ[i] };
+							if (!GeometryUtils::IsCulled(cullMode, hits[i].normal, direction))
+								updateClosestHit(i, hits[i]);
+						}
+						break;
+					}
+					}
+				}
+			});
+	}
+
+	bool Scene::IsOccluded(const Ray& ray) const
+	{
 		for (const auto& plane : m_PlaneGeometries)
 		{
 			if (GeometryUtils::HitTest_Plane(plane, ray))
@@ -125,35 +216,82 @@ namespace dae {
 			}
 		}
 
-		for (const auto& triangle : m_Triangles) {
-			if (GeometryUtils::HitTest_Triangle(triangle, ray))
+		//Stops at the first occluder found, ray.max never shrinks
+		Ray localRay{ ray };
+		return GeometryUtils::TraverseBVH(m_TLAS, localRay, [&](uint32_t primitiveSlot, Ray& currentRay)
 			{
-				return true;
-			}
+				const PrimitiveReference& primitive = m_TLASPrimitives[m_TLAS.GetPrimitiveIndices()[primitiveSlot]];
+				switch (primitive.type)
+				{
+				case PrimitiveType::Sphere:
+					return GeometryUtils::IsOccluded_Sphere(m_SphereGeometries[primitive.index], currentRay);
+				case PrimitiveType::Triangle:
+				{
+					const Triangle& triangle = m_Triangles[primitive.index];
+					return GeometryUtils::IsOccluded_Triangle(triangle.v0, triangle.v1, triangle.v2, currentRay);
+				}
+				case PrimitiveType::TriangleMesh:
+					return GeometryUtils::IsOccluded_TriangleMesh(m_TriangleMeshGeometries[primitive.index], currentRay);
+				case PrimitiveType::TriangleMeshInstance:
+					return GeometryUtils::IsOccluded_TriangleMeshInstance(m_TriangleMeshInstances[primitive.index], currentRay);
+				}
+				return false;
+			});
+	}
+
+	void Scene::BuildAccelerationStructure()
+	{
+		GatherTLASPrimitives();
+		m_TLAS.Build(m_TLASPrimitiveBounds);
+	}
+
+	void Scene::UpdateAccelerationStructure()
+	{
+		GatherTLASPrimitives();
+		m_TLAS.Update(m_TLASPrimitiveBounds, m_TLASRebuildThreshold);
+	}
+
+	void Scene::GatherTLASPrimitives()
+	{
+		m_TLASPrimitives.clear();
+		m_TLASPrimitiveBounds.clear();
+
+		for (uint32_t i = 0; i < m_SphereGeometries.size(); ++i)
+		{
+			const Sphere& sphere = m_SphereGeometries[i];
+			const Vector3 extent{ sphere.radius, sphere.radius, sphere.radius };
+			m_TLASPrimitives.push_back({ PrimitiveType::Sphere, i });
+			m_TLASPrimitiveBounds.push_back({ sphere.origin - extent, sphere.origin + extent });
 		}
 
-		for (const auto& mesh : m_TriangleMeshGeometries)
+		for (uint32_t i = 0; i < m_Triangles.size(); ++i)
 		{
-			for (size_t i = 0; i < mesh.indices.size(); i += 3)
-			{
-				const int i0 = mesh.indices[i];
-				const int i1 = mesh.indices[i + 1];
-				const int i2 = mesh.indices[i + 2];
-				Triangle triangle{
-					mesh.transformedPositions[i0],
-					mesh.transformedPositions[i1],
-					mesh.transformedPositions[i2],
-				};
-				triangle.materialIndex = mesh.materialIndex;
-				triangle.cullMode = mesh.cullMode;
-				if (GeometryUtils::HitTest_Triangle(triangle, ray))
-				{
-					return true;
-				}
-			};
-				
+			const Triangle& triangle = m_Triangles[i];
+			AABB bounds{};
+			bounds.Grow(triangle.v0);
+			bounds.Grow(triangle.v1);
+			bounds.Grow(triangle.v2);
+			m_TLASPrimitives.push_back({ PrimitiveType::Triangle, i });
+			m_TLASPrimitiveBounds.push_back(bounds);
+		}
+
+		for (uint32_t i = 0; i < m_TriangleMeshGeometries.size(); ++i)
+		{
+			const TriangleMesh& mesh = m_TriangleMeshGeometries[i];
+			if (mesh.bvh.IsEmpty())
+				continue;
+			m_TLASPrimitives.push_back({ PrimitiveType::TriangleMesh, i });
+			m_TLASPrimitiveBounds.push_back({ mesh.transformedMinAABB, mesh.transformedMaxAABB });
+		}
+
+		for (uint32_t i = 0; i < m_TriangleMeshInstances.size(); ++i)
+		{
+			const TriangleMeshInstance& instance = m_TriangleMeshInstances[i];
+			if (!instance.pMesh || instance.pMesh->bvh.IsEmpty())
+				continue;
+			m_TLASPrimitives.push_back({ PrimitiveType::TriangleMeshInstance, i });
+			m_TLASPrimitiveBounds.push_back({ instance.transformedMinAABB, instance.transformedMaxAABB });
 		}
-		return false;
 	}
 
 #pragma region Scene Helpers
@@ -189,6 +327,18 @@ namespace dae {
 		return &m_TriangleMeshGeometries.back();
 	}
 
+	TriangleMesh* Scene::AddSharedTriangleMesh()
+	{
+		m_SharedTriangleMeshes.push_back(new TriangleMesh{});
+		return m_SharedTriangleMeshes.back();
+	}
+
+	TriangleMeshInstance* Scene::AddTriangleMeshInstance(const TriangleMesh* pMesh, TriangleCullMode cullMode, unsigned char materialIndex)
+	{
+		m_TriangleMeshInstances.emplace_back(pMesh, cullMode, materialIndex);
+		return &m_TriangleMeshInstances.back();
+	}
+
 	Light* Scene::AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color)
 	{
 		Light l;
@@ -213,9 +363,20 @@ namespace dae {
 		return &m_Lights.back();
 	}
 
+	bool Scene::AdvanceAnimation(const Timer* pTimer)
+	{
+		if (m_IsAnimationPaused)
+			return false;
+
+		m_AnimationTime += pTimer->GetElapsed();
+		++m_ChangeCount;
+		return true;
+	}
+
 	unsigned char Scene::AddMaterial(Material* pMaterial)
 	{
 		m_Materials.push_back(pMaterial);
+		m_MaterialTable.push_back(pMaterial->GetData());
 		return static_cast<unsigned char>(m_Materials.size() - 1);
 	}
 #pragma endregion
@@ -279,8 +440,10 @@ namespace dae {
 	void Scene_W4_TestScene::Update(dae::Timer* pTimer)
 	{
 		Scene::Update(pTimer);
+		if (!AdvanceAnimation(pTimer))
+			return;
 
-		const auto yawAngle = (cos(pTimer->GetTotal()) + 1.f) / 2.f * PI_2;
+		const auto yawAngle = (cos(m_AnimationTime) + 1.f) / 2.f * PI_2;
 		for(auto& mesh : m_Meshes)
 		{
 			mesh->RotateY(yawAngle);
@@ -312,17 +475,23 @@ namespace dae {
 		AddPlane({ 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f }, matLambert_GrayBlue); //BOTTOM
 		AddPlane({ 0.f, 10.f, 0.f }, { 0.f, -1.f, 0.f }, matLambert_GrayBlue); //TOP
 
-		m_pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		Utils::ParseOBJ("resources/lowpoly_bunny.obj",
-			m_pMesh->positions,
-			m_pMesh->normals,
-			m_pMesh->indices);
-
-		m_pMesh->Translate({ 0.f, 1.5f, 0.f });
+		TriangleMesh* pBunnyMesh = AddSharedTriangleMesh();
+		OBJLoadReport loadReport{};
+		if (Utils::LoadOBJMesh("resources/lowpoly_bunny.obj", *pBunnyMesh, &loadReport))
+		{
+			std::cout << "Loaded resources/lowpoly_bunny.obj" << (loadReport.isCached ? " from its mesh cache: " : ": ")
+				<< loadReport.vertexCount << " vertices, " << loadReport.triangleCount << " triangles in " << loadReport.loadTime * 1000.0 << "ms" << std::endl;
+		}
+		else
+		{
+			std::cout << "Could not load resources/lowpoly_bunny.obj" << std::endl;
+		}
 
-		m_pMesh->UpdateAABB();
+		pBunnyMesh->UpdateTransforms();
 
-		m_pMesh->UpdateTransforms();
+		m_pMeshInstance = AddTriangleMeshInstance(pBunnyMesh, TriangleCullMode::BackFaceCulling, matLambert_White);
+		m_pMeshInstance->Translate({ 0.f, 1.5f, 0.f });
+		m_pMeshInstance->UpdateTransforms();
 
 		AddPointLight({ 0.f, 5.f, 5.f }, 50.f, ColorRGB{ 1.f,.61f,.45f });//back light
 		AddPointLight({ -2.5f, 5.f, -5.f }, 70.f, ColorRGB{ 1.f,.8f,.45f });//front left light
@@ -331,9 +500,11 @@ namespace dae {
 	void Scene_W4_BunnyScene::Update(dae::Timer* pTimer)
 	{
 		Scene::Update(pTimer);
+		if (!AdvanceAnimation(pTimer))
+			return;
 
-		m_pMesh->RotateY(PI_DIV_2 * pTimer->GetTotal());
-		m_pMesh->UpdateTransforms();
+		m_pMeshInstance->RotateY(PI_DIV_2 * m_AnimationTime);
+		m_pMeshInstance->UpdateTransforms();
 	}
 #pragma endregion
 }
@@ -1,18 +1,21 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
 #include "Math.h"
 #include "DataTypes.h"
+#include "BVH.h"
 #include "Camera.h"
+#include "Material.h"
 
 namespace dae
 {
 	//Forward Declarations
 	class Timer;
-	class Material;
 	struct Plane;
 	struct Sphere;
 	struct Light;
+	struct RayPacket;
 
 	//Scene Base Class
 	class Scene
@@ -32,14 +35,31 @@ namespace dae
 			m_Camera.Update(pTimer);
 		}
 
+		//Animated scenes freeze while paused, so the renderer can keep refining a still image
+		void ToggleAnimation() { m_IsAnimationPaused = !m_IsAnimationPaused; }
+		bool IsAnimationPaused() const { return m_IsAnimationPaused; }
+		//Bumped whenever geometry moved, the renderer restarts accumulating samples when it changes
+		uint32_t GetChangeCount() const { return m_ChangeCount; }
+
 		Camera& GetCamera() { return m_Camera; }
 		void GetClosestHit(const Ray& ray, HitRecord& closestHit) const;
-		bool DoesHit(const Ray& ray) const;
+		//Closest hits of a whole packet, pHitRecords holds one record per ray. Coherent packets are traced through the
+		//acceleration structures together, incoherent ones ray by ray.
+		void GetClosestHits(const RayPacket& packet, HitRecord* pHitRecords) const;
+		//Shadow ray query, true as soon as any geometry lies within [ray.min, ray.max]
+		bool IsOccluded(const Ray& ray) const;
+
+		//Rebuilds the top-level BVH over all bounded geometry, call after Initialize and whenever geometry was added
+		void BuildAccelerationStructure();
+		//Refits the top-level BVH to moved geometry, rebuilding only when its quality degraded too far
+		void UpdateAccelerationStructure();
 
 		const std::vector<Plane>& GetPlaneGeometries() const { return m_PlaneGeometries; }
 		const std::vector<Sphere>& GetSphereGeometries() const { return m_SphereGeometries; }
 		const std::vector<Light>& GetLights() const { return m_Lights; }
-		const std::vector<Material*> GetMaterials() const { return m_Materials; }
+		const std::vector<Material*>& GetMaterials() const { return m_Materials; }
+		//Flat copies of the materials in the same order, shading reads these instead of calling through the pointers
+		const std::vector<MaterialData>& GetMaterialTable() const { return m_MaterialTable; }
 
 	protected:
 		std::string	sceneName;
@@ -47,17 +67,53 @@ namespace dae
 		std::vector<Plane> m_PlaneGeometries{};
 		std::vector<Sphere> m_SphereGeometries{};
 		std::vector<TriangleMesh> m_TriangleMeshGeometries{};
+		std::vector<TriangleMesh*> m_SharedTriangleMeshes{};
+		std::vector<TriangleMeshInstance> m_TriangleMeshInstances{};
 		std::vector<Light> m_Lights{};
 		std::vector<Material*> m_Materials{};
+		std::vector<MaterialData> m_MaterialTable{};
 
 		//temp
 		std::vector<Triangle> m_Triangles{};
 
 		Camera m_Camera{};
 
+		//Only advances while the animation is not paused
+		float m_AnimationTime{};
+		bool m_IsAnimationPaused{ false };
+		uint32_t m_ChangeCount{};
+
+		//Advances m_AnimationTime and marks the scene as changed, returns false while paused
+		bool AdvanceAnimation(const Timer* pTimer);
+
+		//Top-level acceleration structure, planes are unbounded and stay out of it
+		enum class PrimitiveType : uint8_t
+		{
+			Sphere,
+			Triangle,
+			TriangleMesh,
+			TriangleMeshInstance
+		};
+
+		struct PrimitiveReference final
+		{
+			PrimitiveType type{};
+			uint32_t index{};
+		};
+
+		BVH m_TLAS{};
+		std::vector<PrimitiveReference> m_TLASPrimitives{};
+		std::vector<AABB> m_TLASPrimitiveBounds{};
+		float m_TLASRebuildThreshold{ 1.5f };
+
+		void GatherTLASPrimitives();
+
 		Sphere* AddSphere(const Vector3& origin, float radius, unsigned char materialIndex = 0);
 		Plane* AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex = 0);
 		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		//Shared meshes are owned by the scene and only rendered through instances
+		TriangleMesh* AddSharedTriangleMesh();
+		TriangleMeshInstance* AddTriangleMeshInstance(const TriangleMesh* pMesh, TriangleCullMode cullMode, unsigned char materialIndex = 0);
 
 		Light* AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color);
 		Light* AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color);
@@ -141,6 +197,6 @@ namespace dae
 		void Initialize() override;
 		void Update(dae::Timer* pTimer) override;
 	private:
-		TriangleMesh* m_pMesh = nullptr;
+		TriangleMeshInstance* m_pMeshInstance = nullptr;
 	};
 }
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include "ThreadPool.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#endif
+
+namespace dae
+{
+	static uint64_t PackRange(uint32_t begin, uint32_t end)
+	{
+		return (static_cast<uint64_t>(end) << 32) | begin;
+	}
+
+	static uint32_t RangeBegin(uint64_t range)
+	{
+		return static_cast<uint32_t>(range);
+	}
+
+	static uint32_t RangeEnd(uint64_t range)
+	{
+		return static_cast<uint32_t>(range >> 32);
+	}
+
+	//Best effort, platforms without an affinity API just run unpinned
+	static void PinThread(std::thread& thread, uint32_t core)
+	{
+#if defined(_WIN32)
+		SetThreadAffinityMask(thread.native_handle(), DWORD_PTR{ 1 } << (core % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		CPU_SET(core, &cpuSet);
+		pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuSet);
+#else
+		(void)thread;
+		(void)core;
+#endif
+	}
+
+	ThreadPool::ThreadPool(uint32_t threadCount, bool pinThreads)
+	{
+		const uint32_t hardwareThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
+		if (threadCount == 0)
+			threadCount = hardwareThreadCount;
+
+		m_pQueues = std::make_unique<WorkQueue[]>(threadCount);
+
+		m_Workers.reserve(threadCount - 1);
+		for (uint32_t i = 1; i < threadCount; ++i)
+		{
+			std::thread& worker = m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+			//The calling thread keeps core 0 to itself
+			if (pinThreads)
+				PinThread(worker, i % hardwareThreadCount);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_IsStopping = true;
+		}
+		m_WorkAvailable.notify_all();
+
+		for (std::thread& worker : m_Workers)
+		{
+			worker.join();
+		}
+	}
+
+	void ThreadPool::ParallelFor(uint32_t taskCount, const std::function<void(uint32_t)>& task)
+	{
+		if (taskCount == 0)
+			return;
+
+		if (m_Workers.empty())
+		{
+			for (uint32_t i = 0; i < taskCount; ++i)
+			{
+				task(i);
+			}
+			return;
+		}
+
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_pTask = &task;
+
+			const uint32_t threadCount = GetThreadCount();
+			for (uint32_t i = 0; i < threadCount; ++i)
+			{
+				const uint32_t begin = static_cast<uint32_t>(uint64_t{ taskCount } * i / threadCount);
+				const uint32_t end = static_cast<uint32_t>(uint64_t{ taskCount } * (i + 1) / threadCount);
+				m_pQueues[i].range.store(PackRange(begin, end), std::memory_order_relaxed);
+			}
+
+			m_PendingWorkers = static_cast<uint32_t>(m_Workers.size());
+			++m_Generation;
+		}
+		m_WorkAvailable.notify_all();
+
+		RunTasks(0);
+
+		//Workers still hold a pointer to the task, so it has to outlive all of them
+		std::unique_lock lock{ m_Mutex };
+		m_WorkFinished.wait(lock, [this] { return m_PendingWorkers == 0; });
+		m_pTask = nullptr;
+	}
+
+	void ThreadPool::WorkerLoop(uint32_t threadIndex)
+	{
+		uint32_t seenGeneration = 0;
+		while (true)
+		{
+			{
+				std::unique_lock lock{ m_Mutex };
+				m_WorkAvailable.wait(lock, [&] { return m_IsStopping || m_Generation != seenGeneration; });
+				if (m_IsStopping)
+					return;
+				seenGeneration = m_Generation;
+			}
+
+			RunTasks(threadIndex);
+
+			std::lock_guard lock{ m_Mutex };
+			if (--m_PendingWorkers == 0)
+				m_WorkFinished.notify_one();
+		}
+	}
+
+	void ThreadPool::RunTasks(uint32_t threadIndex)
+	{
+		//Tasks are never added once a ParallelFor started, so a thread that finds every queue empty is done
+		uint32_t taskIndex{};
+		do
+		{
+			while (PopTask(threadIndex, taskIndex))
+			{
+				(*m_pTask)(taskIndex);
+			}
+		} while (StealTasks(threadIndex));
+	}
+
+	bool ThreadPool::PopTask(uint32_t threadIndex, uint32_t& taskIndex)
+	{
+		std::atomic<uint64_t>& range = m_pQueues[threadIndex].range;
+		uint64_t current = range.load(std::memory_order_acquire);
+		while (RangeBegin(current) < RangeEnd(current))
+		{
+			if (range.compare_exchange_weak(current, PackRange(RangeBegin(current) + 1, RangeEnd(current)), std::memory_order_acq_rel))
+			{
+				taskIndex = RangeBegin(current);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool ThreadPool::StealTasks(uint32_t threadIndex)
+	{
+		const uint32_t threadCount = GetThreadCount();
+		for (uint32_t offset = 1; offset < threadCount; ++offset)
+		{
+			std::atomic<uint64_t>& victimRange = m_pQueues[(threadIndex + offset) % threadCount].range;
+			uint64_t current = victimRange.load(std::memory_order_acquire);
+			while (RangeBegin(current) < RangeEnd(current))
+			{
+				//Take the back half, rounded up so a single remaining task can be stolen too
+				const uint32_t begin = RangeBegin(current);
+				const uint32_t end = RangeEnd(current);
+				const uint32_t splitIndex = end - (end - begin + 1) / 2;
+				if (victimRange.compare_exchange_weak(current, PackRange(begin, splitIndex), std::memory_order_acq_rel))
+				{
+					//Nobody pushes to a queue but its owner, and the owner only steals once its own queue is empty
+					m_pQueues[threadIndex].range.store(PackRange(splitIndex, end), std::memory_order_release);
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+}
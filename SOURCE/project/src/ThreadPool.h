@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	//Fixed set of worker threads that live as long as the pool, so dispatching work does not start any threads.
+	//Every thread owns a deque of task indices and steals from the others once it runs dry, which balances uneven tasks.
+	class ThreadPool final
+	{
+	public:
+		//threadCount includes the calling thread, 0 uses every hardware thread.
+		//pinThreads binds every worker to its own core, so its caches survive between frames.
+		explicit ThreadPool(uint32_t threadCount = 0, bool pinThreads = false);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) noexcept = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) noexcept = delete;
+
+		//Runs task(i) for every i in [0, taskCount). The calling thread helps out and it returns once every task has finished.
+		//Every thread starts on its own contiguous share of the indices, so neighbouring tasks stay on one thread.
+		void ParallelFor(uint32_t taskCount, const std::function<void(uint32_t)>& task);
+
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Workers.size()) + 1; }
+
+	private:
+		//Range of task indices packed as (end << 32 | begin), so the owner and thieves race on a single compare exchange.
+		//The owner takes from the front, thieves take the back half.
+		struct alignas(64) WorkQueue
+		{
+			std::atomic<uint64_t> range{};
+		};
+
+		std::vector<std::thread> m_Workers{};
+		//One per thread, the calling thread uses the first one
+		std::unique_ptr<WorkQueue[]> m_pQueues{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WorkAvailable{};
+		std::condition_variable m_WorkFinished{};
+
+		const std::function<void(uint32_t)>* m_pTask{};
+
+		//Bumped for every ParallelFor, every worker takes part in every generation before the call returns
+		uint32_t m_Generation{};
+		uint32_t m_PendingWorkers{};
+		bool m_IsStopping{};
+
+		void WorkerLoop(uint32_t threadIndex);
+		void RunTasks(uint32_t threadIndex);
+
+		bool PopTask(uint32_t threadIndex, uint32_t& taskIndex);
+		bool StealTasks(uint32_t threadIndex);
+	};
+}
@@ -70,6 +70,14 @@ void Timer::Update()
 		return;
 	}
 
+	if (m_FixedTimeStep > 0.0f)
+	{
+		//Simulated time, so offline renders animate the same no matter how long a frame took
+		m_ElapsedTime = m_FixedTimeStep;
+		m_TotalTime += m_FixedTimeStep;
+		return;
+	}
+
 	const uint64_t currentTime = SDL_GetPerformanceCounter();
 	m_CurrentTime = currentTime;
 
@@ -16,6 +16,8 @@ namespace dae
 		Timer& operator=(Timer&&) noexcept = delete;
 
 		void StartBenchmark(int numFrames = 10);
+		//Advances by exactly this many seconds per Update instead of wall clock time, 0 goes back to real time
+		void SetFixedTimeStep(float seconds) { m_FixedTimeStep = seconds; }
 
 		void Reset();
 		void Start();
@@ -44,6 +46,7 @@ namespace dae
 		float m_SecondsPerCount = 0.0f;
 		float m_ElapsedUpperBound = 0.03f;
 		float m_FPSTimer = 0.0f;
+		float m_FixedTimeStep = 0.0f;
 
 		bool m_IsStopped = true;
 		bool m_ForceElapsedUpperBound = false;
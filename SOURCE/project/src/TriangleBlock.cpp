@@ -0,0 +1,179 @@
+#include <bit>
+#include "TriangleBlock.h"
+#include "DataTypes.h"
+#include "SIMD.h"
+
+#if defined(DAE_SIMD_X86)
+#include <immintrin.h>
+#endif
+
+namespace dae
+{
+	namespace GeometryUtils
+	{
+#if defined(DAE_SIMD_X86)
+#pragma region SSE
+		int IntersectTriangleBlock(const TriangleBlock4& block, const Ray& ray, float& t)
+		{
+			const __m128 dx = _mm_set1_ps(ray.direction.x);
+			const __m128 dy = _mm_set1_ps(ray.direction.y);
+			const __m128 dz = _mm_set1_ps(ray.direction.z);
+
+			const __m128 edge1x = _mm_load_ps(block.edge1x);
+			const __m128 edge1y = _mm_load_ps(block.edge1y);
+			const __m128 edge1z = _mm_load_ps(block.edge1z);
+			const __m128 edge2x = _mm_load_ps(block.edge2x);
+			const __m128 edge2y = _mm_load_ps(block.edge2y);
+			const __m128 edge2z = _mm_load_ps(block.edge2z);
+
+			//p = direction x edge2
+			const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, edge2z), _mm_mul_ps(dz, edge2y));
+			const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, edge2x), _mm_mul_ps(dx, edge2z));
+			const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, edge2y), _mm_mul_ps(dy, edge2x));
+
+			const __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1x, px), _mm_mul_ps(edge1y, py)), _mm_mul_ps(edge1z, pz));
+			const __m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1.f), determinant);
+
+			//s = origin - v0
+			const __m128 sx = _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_load_ps(block.v0x));
+			const __m128 sy = _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_load_ps(block.v0y));
+			const __m128 sz = _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_load_ps(block.v0z));
+
+			//q = s x edge1
+			const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, edge1z), _mm_mul_ps(sz, edge1y));
+			const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, edge1x), _mm_mul_ps(sx, edge1z));
+			const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, edge1y), _mm_mul_ps(sy, edge1x));
+
+			const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDeterminant);
+			const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverseDeterminant);
+			const __m128 distances = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edge2x, qx), _mm_mul_ps(edge2y, qy)), _mm_mul_ps(edge2z, qz)), inverseDeterminant);
+
+			const __m128 zero = _mm_setzero_ps();
+			__m128 mask = _mm_cmpneq_ps(determinant, zero);
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+			mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.f)));
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(distances, _mm_set1_ps(ray.min)));
+			mask = _mm_and_ps(mask, _mm_cmple_ps(distances, _mm_set1_ps(ray.max)));
+
+			const int hitLanes = _mm_movemask_ps(mask);
+			if (hitLanes == 0)
+				return -1;
+
+			//Horizontal minimum over the lanes that hit
+			const __m128 candidates = _mm_or_ps(_mm_and_ps(mask, distances), _mm_andnot_ps(mask, _mm_set1_ps(FLT_MAX)));
+			__m128 minimum = _mm_min_ps(candidates, _mm_shuffle_ps(candidates, candidates, _MM_SHUFFLE(2, 3, 0, 1)));
+			minimum = _mm_min_ps(minimum, _mm_shuffle_ps(minimum, minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+
+			const int closestLanes = _mm_movemask_ps(_mm_cmpeq_ps(candidates, minimum)) & hitLanes;
+			t = _mm_cvtss_f32(minimum);
+			return std::countr_zero(static_cast<unsigned>(closestLanes));
+		}
+#pragma endregion
+#pragma region AVX2
+		DAE_TARGET_AVX2 int IntersectTriangleBlock(const TriangleBlock8& block, const Ray& ray, float& t)
+		{
+			const __m256 dx = _mm256_set1_ps(ray.direction.x);
+			const __m256 dy = _mm256_set1_ps(ray.direction.y);
+			const __m256 dz = _mm256_set1_ps(ray.direction.z);
+
+			const __m256 edge1x = _mm256_load_ps(block.edge1x);
+			const __m256 edge1y = _mm256_load_ps(block.edge1y);
+			const __m256 edge1z = _mm256_load_ps(block.edge1z);
+			const __m256 edge2x = _mm256_load_ps(block.edge2x);
+			const __m256 edge2y = _mm256_load_ps(block.edge2y);
+			const __m256 edge2z = _mm256_load_ps(block.edge2z);
+
+			//p = direction x edge2
+			const __m256 px = _mm256_fmsub_ps(dy, edge2z, _mm256_mul_ps(dz, edge2y));
+			const __m256 py = _mm256_fmsub_ps(dz, edge2x, _mm256_mul_ps(dx, edge2z));
+			const __m256 pz = _mm256_fmsub_ps(dx, edge2y, _mm256_mul_ps(dy, edge2x));
+
+			const __m256 determinant = _mm256_fmadd_ps(edge1x, px, _mm256_fmadd_ps(edge1y, py, _mm256_mul_ps(edge1z, pz)));
+			const __m256 inverseDeterminant = _mm256_div_ps(_mm256_set1_ps(1.f), determinant);
+
+			//s = origin - v0
+			const __m256 sx = _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), _mm256_load_ps(block.v0x));
+			const __m256 sy = _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), _mm256_load_ps(block.v0y));
+			const __m256 sz = _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), _mm256_load_ps(block.v0z));
+
+			//q = s x edge1
+			const __m256 qx = _mm256_fmsub_ps(sy, edge1z, _mm256_mul_ps(sz, edge1y));
+			const __m256 qy = _mm256_fmsub_ps(sz, edge1x, _mm256_mul_ps(sx, edge1z));
+			const __m256 qz = _mm256_fmsub_ps(sx, edge1y, _mm256_mul_ps(sy, edge1x));
+
+			const __m256 u = _mm256_mul_ps(_mm256_fmadd_ps(sx, px, _mm256_fmadd_ps(sy, py, _mm256_mul_ps(sz, pz))), inverseDeterminant);
+			const __m256 v = _mm256_mul_ps(_mm256_fmadd_ps(dx, qx, _mm256_fmadd_ps(dy, qy, _mm256_mul_ps(dz, qz))), inverseDeterminant);
+			const __m256 distances = _mm256_mul_ps(_mm256_fmadd_ps(edge2x, qx, _mm256_fmadd_ps(edge2y, qy, _mm256_mul_ps(edge2z, qz))), inverseDeterminant);
+
+			const __m256 zero = _mm256_setzero_ps();
+			__m256 mask = _mm256_cmp_ps(determinant, zero, _CMP_NEQ_UQ);
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), _mm256_set1_ps(1.f), _CMP_LE_OQ));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(distances, _mm256_set1_ps(ray.min), _CMP_GE_OQ));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(distances, _mm256_set1_ps(ray.max), _CMP_LE_OQ));
+
+			const int hitLanes = _mm256_movemask_ps(mask);
+			if (hitLanes == 0)
+				return -1;
+
+			//Horizontal minimum over the lanes that hit
+			const __m256 candidates = _mm256_blendv_ps(_mm256_set1_ps(FLT_MAX), distances, mask);
+			__m256 minimum = _mm256_min_ps(candidates, _mm256_permute2f128_ps(candidates, candidates, 0x01));
+			minimum = _mm256_min_ps(minimum, _mm256_shuffle_ps(minimum, minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+			minimum = _mm256_min_ps(minimum, _mm256_shuffle_ps(minimum, minimum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+			const int closestLanes = _mm256_movemask_ps(_mm256_cmp_ps(candidates, minimum, _CMP_EQ_OQ)) & hitLanes;
+			t = _mm256_cvtss_f32(minimum);
+			return std::countr_zero(static_cast<unsigned>(closestLanes));
+		}
+#pragma endregion
+#else
+#pragma region Scalar
+		template<int Width>
+		static int IntersectTriangleBlockScalar(const TriangleBlock<Width>& block, const Ray& ray, float& t)
+		{
+			int closestLane = -1;
+			Ray localRay{ ray };
+			for (int lane = 0; lane < Width; ++lane)
+			{
+				const Vector3 v0{ block.v0x[lane], block.v0y[lane], block.v0z[lane] };
+				const Vector3 edge1{ block.edge1x[lane], block.edge1y[lane], block.edge1z[lane] };
+				const Vector3 edge2{ block.edge2x[lane], block.edge2y[lane], block.edge2z[lane] };
+
+				const Vector3 p = Vector3::Cross(localRay.direction, edge2);
+				const float determinant = Vector3::Dot(edge1, p);
+				if (determinant == 0.f)
+					continue;
+
+				const float inverseDeterminant = 1.f / determinant;
+				const Vector3 s = localRay.origin - v0;
+				const Vector3 q = Vector3::Cross(s, edge1);
+				const float u = Vector3::Dot(s, p) * inverseDeterminant;
+				const float v = Vector3::Dot(localRay.direction, q) * inverseDeterminant;
+				const float distance = Vector3::Dot(edge2, q) * inverseDeterminant;
+				if (u >= 0.f && v >= 0.f && u + v <= 1.f && distance >= localRay.min && distance <= localRay.max)
+				{
+					localRay.max = distance;
+					closestLane = lane;
+				}
+			}
+
+			t = localRay.max;
+			return closestLane;
+		}
+
+		int IntersectTriangleBlock(const TriangleBlock4& block, const Ray& ray, float& t)
+		{
+			return IntersectTriangleBlockScalar(block, ray, t);
+		}
+
+		int IntersectTriangleBlock(const TriangleBlock8& block, const Ray& ray, float& t)
+		{
+			return IntersectTriangleBlockScalar(block, ray, t);
+		}
+#pragma endregion
+#endif
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "Math.h"
+
+namespace dae
+{
+	struct Ray;
+
+	//Structure of arrays of Width triangles, so one ray can be tested against all of them with one SIMD pass.
+	//Unused lanes keep zero edges, which can never produce a hit.
+	template<int Width>
+	struct alignas(Width * sizeof(float)) TriangleBlock final
+	{
+		static constexpr int WIDTH = Width;
+
+		float v0x[Width]{};
+		float v0y[Width]{};
+		float v0z[Width]{};
+		float edge1x[Width]{};
+		float edge1y[Width]{};
+		float edge1z[Width]{};
+		float edge2x[Width]{};
+		float edge2y[Width]{};
+		float edge2z[Width]{};
+
+		void SetLane(int lane, const Vector3& v0, const Vector3& edge1, const Vector3& edge2)
+		{
+			v0x[lane] = v0.x;
+			v0y[lane] = v0.y;
+			v0z[lane] = v0.z;
+			edge1x[lane] = edge1.x;
+			edge1y[lane] = edge1.y;
+			edge1z[lane] = edge1.z;
+			edge2x[lane] = edge2.x;
+			edge2y[lane] = edge2.y;
+			edge2z[lane] = edge2.z;
+		}
+	};
+
+	using TriangleBlock4 = TriangleBlock<4>;
+	using TriangleBlock8 = TriangleBlock<8>;
+
+	namespace GeometryUtils
+	{
+		//Two-sided Möller-Trumbore against every lane. Returns the lane of the closest hit within [ray.min, ray.max]
+		//and writes its distance to t, or returns -1 when no lane was hit.
+		//The 4-wide version uses SSE, the 8-wide one AVX2, only call it when SIMD::GetInstructionSet() reports AVX2.
+		int IntersectTriangleBlock(const TriangleBlock4& block, const Ray& ray, float& t);
+		int IntersectTriangleBlock(const TriangleBlock8& block, const Ray& ray, float& t);
+	}
+}
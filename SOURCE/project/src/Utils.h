@@ -1,7 +1,9 @@
 #pragma once
-#include <fstream>
+#include <bit>
 #include "Math.h"
 #include "DataTypes.h"
+#include "OBJLoader.h"
+#include "RayPacket.h"
 
 namespace dae
 {
@@ -58,7 +60,7 @@ namespace dae
 			float denom = Vector3::Dot(plane.normal, ray.direction);
 
 			// Use a small epsilon to check if the ray is not parallel to the plane
-			if (abs(denom) > 0.0001f)
+			if (std::abs(denom) > 0.0001f)
 			{
 				// Calculate the distance from the ray origin to the plane
 				float t = Vector3::Dot(plane.origin - ray.origin, plane.normal) / denom;
@@ -88,41 +90,49 @@ namespace dae
 #pragma endregion
 #pragma region Triangle HitTest
 		//TRIANGLE HIT-TESTS
-		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		/**
+		 * \brief Two-sided Möller-Trumbore intersection
+		 * \param v0 first vertex
+		 * \param edge1 v1 - v0
+		 * \param edge2 v2 - v0
+		 * \param ray ray to test, only hits within [ray.min, ray.max] count
+		 * \param t distance along the ray
+		 * \param u barycentric weight of v1
+		 * \param v barycentric weight of v2
+		 * \return true on a hit
+		 */
+		inline bool IntersectTriangle_MollerTrumbore(const Vector3& v0, const Vector3& edge1, const Vector3& edge2, const Ray& ray, float& t, float& u, float& v)
 		{
-			auto a = triangle.v1 - triangle.v0;
-			auto b = triangle.v2 - triangle.v0;
-			auto n = Vector3::Cross(a, b);
-			if(Vector3::Dot(n, ray.direction)==0)
-				return false;
-			auto l = triangle.v0 - ray.origin;
-			auto t = Vector3::Dot(n, l) / Vector3::Dot(n, ray.direction);
-			if(t<ray.min || t > ray.max)
+			const Vector3 p = Vector3::Cross(ray.direction, edge2);
+			const float determinant = Vector3::Dot(edge1, p);
+			if (determinant == 0.f)
 				return false;
 
-			auto P = ray.origin + t * ray.direction;
-			auto c = P - triangle.v0;
+			const float inverseDeterminant = 1.f / determinant;
+			const Vector3 s = ray.origin - v0;
+			const Vector3 q = Vector3::Cross(s, edge1);
+
+			u = Vector3::Dot(s, p) * inverseDeterminant;
+			v = Vector3::Dot(ray.direction, q) * inverseDeterminant;
+			t = Vector3::Dot(edge2, q) * inverseDeterminant;
+
+			//Bitwise ands keep this a single branch
+			return (u >= 0.f) & (v >= 0.f) & (u + v <= 1.f) & (t >= ray.min) & (t <= ray.max);
+		}
+
+		inline bool HitTest_TriangleRecord(const TriangleRecord& triangle, const Ray& ray, float& t, float& u, float& v)
+		{
+			return IntersectTriangle_MollerTrumbore(triangle.v0, triangle.edge1, triangle.edge2, ray, t, u, v);
+		}
+
+		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			float t, u, v;
+			if (!IntersectTriangle_MollerTrumbore(triangle.v0, triangle.v1 - triangle.v0, triangle.v2 - triangle.v0, ray, t, u, v))
+				return false;
 
-			for (int i = 0; i < 3; ++i) {
-				switch(i){
-					case 0:
-						a = triangle.v1 - triangle.v0;
-						
-						break;
-					case 1:
-						a = triangle.v2 - triangle.v1;
-						c = P - triangle.v1;
-						break;
-					case 2:
-						a = triangle.v0 - triangle.v2;
-						c = P - triangle.v2;
-						break;
-				}
-				if (Vector3::Dot(Vector3::Cross(a, c), n) < 0)
-					return false;
-			}
 			if(!ignoreHitRecord){
-				hitRecord.origin = P;
+				hitRecord.origin = ray.origin + t * ray.direction;
 				hitRecord.normal = triangle.normal;
 				hitRecord.t = t;
 				hitRecord.didHit = true;
@@ -136,6 +146,19 @@ namespace dae
 			HitRecord temp{};
 			return HitTest_Triangle(triangle, ray, temp, true);
 		}
+
+		inline bool IsCulled(TriangleCullMode cullMode, const Vector3& normal, const Vector3& rayDirection)
+		{
+			switch (cullMode) {
+			case TriangleCullMode::BackFaceCulling:
+				return Vector3::Dot(normal, rayDirection) > 0;
+			case TriangleCullMode::FrontFaceCulling:
+				return Vector3::Dot(normal, rayDirection) < 0;
+			case TriangleCullMode::NoCulling:
+			default:
+				return false;
+			}
+		}
 #pragma endregion
 #pragma region triangle mesh slab test
 		inline bool SlabTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
@@ -161,45 +184,375 @@ namespace dae
 			return tmax > 0 && tmax >= tmin;
 		}
 #pragma endregion
-#pragma region TriangeMesh HitTest
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+#pragma region BVH node slab test
+		//Returns the distance at which the ray enters the node, or FLT_MAX when it misses or the node lies outside [ray.min, ray.max]
+		inline float SlabTest_BVHNode(const BVHNode& node, const Ray& ray, const Vector3& inverseDirection)
 		{
-			if (!SlabTest_TriangleMesh(mesh, ray))
+			const float tx1 = (node.minAABB.x - ray.origin.x) * inverseDirection.x;
+			const float tx2 = (node.maxAABB.x - ray.origin.x) * inverseDirection.x;
+
+			float tmin = std::min(tx1, tx2);
+			float tmax = std::max(tx1, tx2);
+
+			const float ty1 = (node.minAABB.y - ray.origin.y) * inverseDirection.y;
+			const float ty2 = (node.maxAABB.y - ray.origin.y) * inverseDirection.y;
+
+			tmin = std::max(tmin, std::min(ty1, ty2));
+			tmax = std::min(tmax, std::max(ty1, ty2));
+
+			const float tz1 = (node.minAABB.z - ray.origin.z) * inverseDirection.z;
+			const float tz2 = (node.maxAABB.z - ray.origin.z) * inverseDirection.z;
+
+			tmin = std::max(tmin, std::min(tz1, tz2));
+			tmax = std::min(tmax, std::max(tz1, tz2));
+
+			if (tmax >= tmin && tmax >= ray.min && tmin <= ray.max)
+				return tmin;
+			return FLT_MAX;
+		}
+#pragma endregion
+#pragma region BVH traversal
+		//Binary layout of TraverseBVHLeaves, two slab tests per interior node. Starts at rootIndex, which can be any subtree.
+		template<typename Visitor>
+		inline bool TraverseBinaryBVHLeaves(const std::vector<BVHNode>& nodes, Ray& ray, const Vector3& inverseDirection, Visitor&& visitLeaf,
+			uint32_t rootIndex = 0)
+		{
+			if (SlabTest_BVHNode(nodes[rootIndex], ray, inverseDirection) == FLT_MAX)
 				return false;
 
-			bool didHitSomething = false;
-			float closestT = FLT_MAX;
-			HitRecord closestHit{};
-			for (size_t i = 0; i < mesh.indices.size(); i += 3)
+			//Far children wait on the stack with their entry distance, so they can be skipped once ray.max has shrunk past them
+			uint32_t stack[BVH_MAX_DEPTH];
+			float stackDistances[BVH_MAX_DEPTH];
+			uint32_t stackSize = 0;
+			uint32_t nodeIndex = rootIndex;
+			while (true)
 			{
-				const int i0 = mesh.indices[i];
-				const int i1 = mesh.indices[i + 1];
-				const int i2 = mesh.indices[i + 2];
-				Triangle triangle{
-					mesh.transformedPositions[i0],
-					mesh.transformedPositions[i1],
-					mesh.transformedPositions[i2],
-
-				};
-				triangle.materialIndex = mesh.materialIndex;
-				triangle.cullMode = mesh.cullMode;
-				HitRecord hit{};
-				if (HitTest_Triangle(triangle, ray, hit, false))
+				const BVHNode& node = nodes[nodeIndex];
+				if (node.IsLeaf())
+				{
+					if (visitLeaf(node, nodeIndex, ray))
+						return true;
+				}
+				else
 				{
-					didHitSomething = true;
-					if (hit.t < closestT)
+					uint32_t nearChild = node.leftFirst;
+					uint32_t farChild = node.leftFirst + 1;
+					float nearDistance = SlabTest_BVHNode(nodes[nearChild], ray, inverseDirection);
+					float farDistance = SlabTest_BVHNode(nodes[farChild], ray, inverseDirection);
+					if (nearDistance > farDistance)
+					{
+						std::swap(nearChild, farChild);
+						std::swap(nearDistance, farDistance);
+					}
+
+					if (nearDistance != FLT_MAX)
 					{
-						closestT = hit.t;
-						closestHit = hit;
+						if (farDistance != FLT_MAX)
+						{
+							stack[stackSize] = farChild;
+							stackDistances[stackSize] = farDistance;
+							++stackSize;
+						}
+						nodeIndex = nearChild;
+						continue;
 					}
 				}
+
+				//Pop the next node that can still hold a hit closer than ray.max
+				do
+				{
+					if (stackSize == 0)
+						return false;
+					--stackSize;
+				} while (stackDistances[stackSize] > ray.max);
+				nodeIndex = stack[stackSize];
 			}
-			if (didHitSomething && !ignoreHitRecord)
+		}
+
+		//Collapsed layout of TraverseBVHLeaves, one SIMD slab test per node covers all of its children
+		template<int Width, typename Visitor>
+		inline bool TraverseWideBVHLeaves(const std::vector<WideBVHNode<Width>>& wideNodes, const std::vector<BVHNode>& nodes, Ray& ray,
+			const Vector3& inverseDirection, Visitor&& visitLeaf)
+		{
+			using Node = WideBVHNode<Width>;
+
+			//Every visited node pushes at most Width children and pops one, and the collapsed tree is never deeper than the binary one
+			uint32_t stack[BVH_MAX_DEPTH * Width];
+			float stackDistances[BVH_MAX_DEPTH * Width];
+			uint32_t stackSize = 0;
+			uint32_t wideIndex = 0;
+			while (true)
+			{
+				float distances[Width];
+				int hitMask = SlabTest_WideBVHNode(wideNodes[wideIndex], ray, inverseDirection, distances);
+
+				//Push the hit children far to near, so the nearest one is popped first
+				const uint32_t firstHit = stackSize;
+				while (hitMask != 0)
+				{
+					const int child = std::countr_zero(static_cast<unsigned>(hitMask));
+					hitMask &= hitMask - 1;
+
+					uint32_t slot = stackSize++;
+					while (slot > firstHit && stackDistances[slot - 1] < distances[child])
+					{
+						stack[slot] = stack[slot - 1];
+						stackDistances[slot] = stackDistances[slot - 1];
+						--slot;
+					}
+					stack[slot] = wideNodes[wideIndex].children[child];
+					stackDistances[slot] = distances[child];
+				}
+
+				//Pop until the next wide node, visiting leaves on the way, skipping everything beyond ray.max
+				while (true)
+				{
+					if (stackSize == 0)
+						return false;
+					--stackSize;
+					if (stackDistances[stackSize] > ray.max)
+						continue;
+
+					const uint32_t child = stack[stackSize];
+					if ((child & Node::LEAF_FLAG) == 0)
+					{
+						wideIndex = child;
+						break;
+					}
+
+					const uint32_t leafIndex = child & ~Node::LEAF_FLAG;
+					if (visitLeaf(nodes[leafIndex], leafIndex, ray))
+						return true;
+				}
+			}
+		}
+
+		/**
+		 * \brief Walks a BVH front-to-back and hands every leaf the ray reaches to the visitor.
+		 * Uses the collapsed 4 or 8 wide nodes when the hierarchy has them.
+		 * \param bvh hierarchy to traverse
+		 * \param ray ray in the space the hierarchy was built in, the visitor shrinks ray.max on closer hits
+		 * \param visitLeaf callable bool(const BVHNode& leaf, uint32_t leafIndex, Ray& ray), returning true stops the traversal
+		 * \return true when the visitor stopped the traversal
+		 */
+		template<typename Visitor>
+		inline bool TraverseBVHLeaves(const BVH& bvh, Ray& ray, Visitor&& visitLeaf)
+		{
+			if (bvh.IsEmpty())
+				return false;
+
+			const Vector3 inverseDirection{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+			switch (bvh.GetNodeWidth())
+			{
+			case 8:
+				return TraverseWideBVHLeaves(bvh.GetWideNodes8(), bvh.GetNodes(), ray, inverseDirection, visitLeaf);
+			case 4:
+				return TraverseWideBVHLeaves(bvh.GetWideNodes4(), bvh.GetNodes(), ray, inverseDirection, visitLeaf);
+			default:
+				return TraverseBinaryBVHLeaves(bvh.GetNodes(), ray, inverseDirection, visitLeaf);
+			}
+		}
+
+		/**
+		 * \brief Same walk as TraverseBVHLeaves, but visits the primitives of every leaf one by one
+		 * \param visitPrimitive callable bool(uint32_t primitiveSlot, Ray& ray), returning true stops the traversal.
+		 * The slot indexes bvh.GetPrimitiveIndices(), so data stored in BVH order can be read without the indirection.
+		 */
+		template<typename Visitor>
+		inline bool TraverseBVH(const BVH& bvh, Ray& ray, Visitor&& visitPrimitive)
+		{
+			return TraverseBVHLeaves(bvh, ray, [&](const BVHNode& leaf, uint32_t, Ray& currentRay)
+				{
+					for (uint32_t i = 0; i < leaf.primitiveCount; ++i)
+					{
+						if (visitPrimitive(leaf.leftFirst + i, currentRay))
+							return true;
+					}
+					return false;
+				});
+		}
+
+		//Rays of a packet that still share a node below this count finish its subtree one by one
+		constexpr uint32_t RAY_PACKET_MIN_SHARED_RAYS = 4;
+
+		/**
+		 * \brief Walks a BVH with a whole packet of rays and hands every leaf to the visitor with the rays that reach it.
+		 * Nodes are culled for the whole packet with one interval test, then slab tested with one SIMD lane per ray.
+		 * Once fewer than RAY_PACKET_MIN_SHARED_RAYS rays share a node they diverged, and each finishes the subtree with single-ray traversal.
+		 * \param bvh hierarchy to traverse, packets walk its binary nodes
+		 * \param packet rays in the space the hierarchy was built in, the visitor shrinks their max on closer hits
+		 * \param rayMask rays taking part, bit i selects ray i
+		 * \param visitLeaf callable void(const BVHNode& leaf, uint32_t leafIndex, RayPacket& packet, uint64_t rayMask)
+		 */
+		template<typename Visitor>
+		inline void TraverseBVHLeaves(const BVH& bvh, RayPacket& packet, uint64_t rayMask, Visitor&& visitLeaf)
+		{
+			if (bvh.IsEmpty() || rayMask == 0)
+				return;
+
+			const std::vector<BVHNode>& nodes = bvh.GetNodes();
+
+			//Every visited node pushes at most both of its children
+			uint32_t stack[BVH_MAX_DEPTH * 2];
+			uint64_t stackMasks[BVH_MAX_DEPTH * 2];
+			stack[0] = 0;
+			stackMasks[0] = rayMask;
+			uint32_t stackSize = 1;
+			while (stackSize > 0)
+			{
+				--stackSize;
+				const uint32_t nodeIndex = stack[stackSize];
+				const BVHNode& node = nodes[nodeIndex];
+				if (!IntervalTest_RayPacket(node, packet))
+					continue;
+
+				const uint64_t hitMask = SlabTest_RayPacket(node, packet, stackMasks[stackSize]);
+				if (hitMask == 0)
+					continue;
+
+				if (static_cast<uint32_t>(std::popcount(hitMask)) < RAY_PACKET_MIN_SHARED_RAYS)
+				{
+					for (uint64_t remaining = hitMask; remaining != 0; remaining &= remaining - 1)
+					{
+						const uint32_t rayIndex = std::countr_zero(remaining);
+						const uint64_t rayBit = 1ull << rayIndex;
+						const Vector3 inverseDirection{ packet.inverseX[rayIndex], packet.inverseY[rayIndex], packet.inverseZ[rayIndex] };
+
+						Ray ray = packet.GetRay(rayIndex);
+						TraverseBinaryBVHLeaves(nodes, ray, inverseDirection, [&](const BVHNode& leaf, uint32_t leafIndex, Ray& currentRay)
+							{
+								visitLeaf(leaf, leafIndex, packet, rayBit);
+								currentRay.max = packet.max[rayIndex];
+								return false;
+							}, nodeIndex);
+					}
+					continue;
+				}
+
+				if (node.IsLeaf())
+				{
+					visitLeaf(node, nodeIndex, packet, hitMask);
+					continue;
+				}
+
+				//Coherent rays agree on which child is nearer, so the first one decides. The nearer child is pushed last to be visited first.
+				const uint32_t rayIndex = std::countr_zero(hitMask);
+				const Vector3 direction{ packet.directionX[rayIndex], packet.directionY[rayIndex], packet.directionZ[rayIndex] };
+				const BVHNode& left = nodes[node.leftFirst];
+				const BVHNode& right = nodes[node.leftFirst + 1];
+				const bool isLeftNearer = Vector3::Dot(left.minAABB + left.maxAABB - right.minAABB - right.maxAABB, direction) < 0.f;
+
+				stack[stackSize] = isLeftNearer ? node.leftFirst + 1 : node.leftFirst;
+				stackMasks[stackSize] = hitMask;
+				++stackSize;
+				stack[stackSize] = isLeftNearer ? node.leftFirst : node.leftFirst + 1;
+				stackMasks[stackSize] = hitMask;
+				++stackSize;
+			}
+		}
+#pragma endregion
+#pragma region TriangleBlock HitTest
+		//Closest hit among a leaf's SIMD blocks, writes the hit triangle's slot and shrinks ray.max
+		template<int Width>
+		inline bool HitTest_LeafBlocks(const std::vector<TriangleBlock<Width>>& blocks, const TriangleMesh& mesh, const BVHNode& leaf, uint32_t leafIndex, Ray& ray, uint32_t& triangleSlot)
+		{
+			const uint32_t firstBlock = mesh.leafBlockOffsets[leafIndex];
+			const uint32_t blockCount = (leaf.primitiveCount + Width - 1) / Width;
+
+			bool didHit = false;
+			for (uint32_t block = 0; block < blockCount; ++block)
+			{
+				float t;
+				const int lane = IntersectTriangleBlock(blocks[firstBlock + block], ray, t);
+				if (lane >= 0)
+				{
+					ray.max = t;
+					triangleSlot = leaf.leftFirst + block * Width + lane;
+					didHit = true;
+				}
+			}
+			return didHit;
+		}
+
+		//Visits the mesh BVH with the block width it was built for, the visitor gets the hit slot and returns true to stop
+		template<typename Visitor>
+		inline bool TraverseTriangleMesh(const TriangleMesh& mesh, Ray& ray, Visitor&& onHit)
+		{
+			switch (mesh.triangleBlockWidth)
 			{
-				hitRecord = closestHit;
+			case 8:
+				return TraverseBVHLeaves(mesh.bvh, ray, [&](const BVHNode& leaf, uint32_t leafIndex, Ray& currentRay)
+					{
+						uint32_t triangleSlot;
+						return HitTest_LeafBlocks(mesh.triangleBlocks8, mesh, leaf, leafIndex, currentRay, triangleSlot)
+							&& onHit(triangleSlot);
+					});
+			case 4:
+				return TraverseBVHLeaves(mesh.bvh, ray, [&](const BVHNode& leaf, uint32_t leafIndex, Ray& currentRay)
+					{
+						uint32_t triangleSlot;
+						return HitTest_LeafBlocks(mesh.triangleBlocks4, mesh, leaf, leafIndex, currentRay, triangleSlot)
+							&& onHit(triangleSlot);
+					});
+			default:
+				return TraverseBVH(mesh.bvh, ray, [&](uint32_t triangleSlot, Ray& currentRay)
+					{
+						float t, u, v;
+						if (!HitTest_TriangleRecord(mesh.triangleRecords[triangleSlot], currentRay, t, u, v))
+							return false;
+						currentRay.max = t;
+						return onHit(triangleSlot);
+					});
 			}
-			return didHitSomething;
+		}
+		//Packet version of TraverseTriangleMesh: shrinks the max of every ray in rayMask to its closest triangle and writes that triangle's slot.
+		//Returns the mask of rays that hit. Every lane is one ray, so triangles are tested one at a time instead of in blocks.
+		inline uint64_t TraverseTriangleMesh(const TriangleMesh& mesh, RayPacket& packet, uint64_t rayMask, uint32_t triangleSlots[RAY_PACKET_SIZE])
+		{
+			uint64_t hitMask = 0;
+			TraverseBVHLeaves(mesh.bvh, packet, rayMask, [&](const BVHNode& leaf, uint32_t, RayPacket& currentPacket, uint64_t leafMask)
+				{
+					for (uint32_t slot = leaf.leftFirst; slot < leaf.leftFirst + leaf.primitiveCount; ++slot)
+					{
+						uint64_t triangleHits = IntersectTriangle_RayPacket(mesh.triangleRecords[slot], currentPacket, leafMask);
+						hitMask |= triangleHits;
+						for (; triangleHits != 0; triangleHits &= triangleHits - 1)
+						{
+							triangleSlots[std::countr_zero(triangleHits)] = slot;
+						}
+					}
+				});
+			return hitMask;
+		}
+#pragma endregion
+#pragma region TriangeMesh HitTest
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			if (!SlabTest_TriangleMesh(mesh, ray))
+				return false;
 
+			//ray.max shrinks with every hit so farther nodes and triangles get culled
+			Ray localRay{ ray };
+			const TriangleRecord* pClosestTriangle = nullptr;
+
+			TraverseTriangleMesh(mesh, localRay, [&](uint32_t triangleSlot)
+				{
+					pClosestTriangle = &mesh.triangleRecords[triangleSlot];
+					return false;
+				});
+
+			if (!pClosestTriangle)
+				return false;
+
+			if (!ignoreHitRecord)
+			{
+				hitRecord.origin = ray.origin + localRay.max * ray.direction;
+				hitRecord.normal = pClosestTriangle->normal;
+				hitRecord.t = localRay.max;
+				hitRecord.didHit = true;
+				hitRecord.materialIndex = pClosestTriangle->materialIndex;
+			}
+			return true;
 		}
 
 		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
@@ -207,6 +560,135 @@ namespace dae
 			HitRecord temp{};
 			return HitTest_TriangleMesh(mesh, ray, temp, true);
 		}
+
+		//Hit records of the closest triangle for every ray of the packet in rayMask, returns the mask of rays that hit the mesh
+		inline uint64_t HitTest_TriangleMesh(const TriangleMesh& mesh, const RayPacket& packet, uint64_t rayMask, HitRecord* pHitRecords)
+		{
+			RayPacket localPacket{ packet };
+			uint32_t triangleSlots[RAY_PACKET_SIZE];
+			const uint64_t hitMask = TraverseTriangleMesh(mesh, localPacket, rayMask, triangleSlots);
+
+			for (uint64_t remaining = hitMask; remaining != 0; remaining &= remaining - 1)
+			{
+				const uint32_t i = std::countr_zero(remaining);
+				const TriangleRecord& triangle = mesh.triangleRecords[triangleSlots[i]];
+				const float t = localPacket.max[i];
+
+				HitRecord& hitRecord = pHitRecords[i];
+				hitRecord.origin = Vector3{ packet.originX[i], packet.originY[i], packet.originZ[i] }
+					+ t * Vector3{ packet.directionX[i], packet.directionY[i], packet.directionZ[i] };
+				hitRecord.normal = triangle.normal;
+				hitRecord.t = t;
+				hitRecord.didHit = true;
+				hitRecord.materialIndex = triangle.materialIndex;
+			}
+			return hitMask;
+		}
+#pragma endregion
+#pragma region TriangleMeshInstance HitTest
+		inline bool HitTest_TriangleMeshInstance(const TriangleMeshInstance& instance, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			//The direction is not renormalized, so t along the object space ray equals t along the world ray
+			const Ray objectRay{
+				instance.worldToObject.TransformPoint(ray.origin),
+				instance.worldToObject.TransformVector(ray.direction),
+				ray.min,
+				ray.max
+			};
+
+			HitRecord objectHit{};
+			if (!HitTest_TriangleMesh(*instance.pMesh, objectRay, objectHit, ignoreHitRecord))
+				return false;
+
+			if (!ignoreHitRecord)
+			{
+				hitRecord.origin = ray.origin + objectHit.t * ray.direction;
+				hitRecord.normal = instance.normalToWorld.TransformVector(objectHit.normal).Normalized();
+				hitRecord.t = objectHit.t;
+				hitRecord.didHit = true;
+				hitRecord.materialIndex = instance.materialIndex;
+			}
+			return true;
+		}
+
+		inline bool HitTest_TriangleMeshInstance(const TriangleMeshInstance& instance, const Ray& ray)
+		{
+			HitRecord temp{};
+			return HitTest_TriangleMeshInstance(instance, ray, temp, true);
+		}
+
+		inline uint64_t HitTest_TriangleMeshInstance(const TriangleMeshInstance& instance, const RayPacket& packet, uint64_t rayMask, HitRecord* pHitRecords)
+		{
+			//An affine transform keeps coherent rays coherent, so the packet stays together in object space
+			RayPacket objectPacket{};
+			objectPacket.Transform(packet, instance.worldToObject);
+
+			uint32_t triangleSlots[RAY_PACKET_SIZE];
+			const uint64_t hitMask = TraverseTriangleMesh(*instance.pMesh, objectPacket, rayMask, triangleSlots);
+
+			for (uint64_t remaining = hitMask; remaining != 0; remaining &= remaining - 1)
+			{
+				const uint32_t i = std::countr_zero(remaining);
+				const TriangleRecord& triangle = instance.pMesh->triangleRecords[triangleSlots[i]];
+				const float t = objectPacket.max[i];
+
+				HitRecord& hitRecord = pHitRecords[i];
+				hitRecord.origin = Vector3{ packet.originX[i], packet.originY[i], packet.originZ[i] }
+					+ t * Vector3{ packet.directionX[i], packet.directionY[i], packet.directionZ[i] };
+				hitRecord.normal = instance.normalToWorld.TransformVector(triangle.normal).Normalized();
+				hitRecord.t = t;
+				hitRecord.didHit = true;
+				hitRecord.materialIndex = instance.materialIndex;
+			}
+			return hitMask;
+		}
+#pragma endregion
+#pragma region Occlusion tests
+		//Any-hit queries for shadow rays: only answer whether something lies within [ray.min, ray.max], no hit record work
+
+		inline bool IsOccluded_Sphere(const Sphere& sphere, const Ray& ray)
+		{
+			const Vector3 L = sphere.origin - ray.origin;
+			const float tca = Vector3::Dot(L, ray.direction);
+			const float d2 = Vector3::Dot(L, L) - tca * tca;
+			const float radius2 = sphere.radius * sphere.radius;
+			if (d2 > radius2)
+				return false;
+
+			const float thc = sqrtf(radius2 - d2);
+			const float t0 = tca - thc;
+			const float t1 = tca + thc;
+			return (t0 >= ray.min && t0 <= ray.max) || (t1 >= ray.min && t1 <= ray.max);
+		}
+
+		inline bool IsOccluded_Triangle(const Vector3& v0, const Vector3& v1, const Vector3& v2, const Ray& ray)
+		{
+			float t, u, v;
+			return IntersectTriangle_MollerTrumbore(v0, v1 - v0, v2 - v0, ray, t, u, v);
+		}
+
+		inline bool IsOccluded_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
+		{
+			if (!SlabTest_TriangleMesh(mesh, ray))
+				return false;
+
+			Ray localRay{ ray };
+			return TraverseTriangleMesh(mesh, localRay, [](uint32_t)
+				{
+					return true;
+				});
+		}
+
+		inline bool IsOccluded_TriangleMeshInstance(const TriangleMeshInstance& instance, const Ray& ray)
+		{
+			const Ray objectRay{
+				instance.worldToObject.TransformPoint(ray.origin),
+				instance.worldToObject.TransformVector(ray.direction),
+				ray.min,
+				ray.max
+			};
+			return IsOccluded_TriangleMesh(*instance.pMesh, objectRay);
+		}
 #pragma endregion
 	}
 
@@ -236,71 +718,10 @@ namespace dae
 
 	namespace Utils
 	{
-#pragma warning(push)
-#pragma warning(disable : 4505) //Warning unreferenced local function
-		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
+		//Kept for existing callers, LoadOBJ also reports what it loaded
+		inline bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
 		{
-			std::ifstream file(filename);
-			if (!file)
-				return false;
-
-			std::string sCommand;
-
-			while (!file.eof())
-			{
-				file >> sCommand;
-				if (sCommand == "#")
-				{
-					// Ignore Comment
-				}
-				else if (sCommand == "v")
-				{
-					//Vertex
-					float x, y, z;
-					file >> x >> y >> z;
-					positions.push_back({ x, y, z });
-				}
-				else if (sCommand == "f")
-				{
-					float i0, i1, i2;
-					file >> i0 >> i1 >> i2;
-
-					indices.push_back((int)i0 - 1);
-					indices.push_back((int)i1 - 1);
-					indices.push_back((int)i2 - 1);
-				}
-				file.ignore(1000, '\n');
-
-				if (file.eof())
-					break;
-			}
-
-			for (uint64_t index = 0; index < indices.size(); index += 3)
-			{
-				uint32_t i0 = indices[index];
-				uint32_t i1 = indices[index + 1];
-				uint32_t i2 = indices[index + 2];
-
-				Vector3 edgeV0V1 = positions[i1] - positions[i0];
-				Vector3 edgeV0V2 = positions[i2] - positions[i0];
-				Vector3 normal = Vector3::Cross(edgeV0V1, edgeV0V2);
-
-				if (std::isnan(normal.x))
-				{
-					int k = 0;
-				}
-
-				normal.Normalize();
-				if (std::isnan(normal.x))
-				{
-					int k = 0;
-				}
-
-				normals.push_back(normal);
-			}
-
-			return true;
+			return LoadOBJ(filename, positions, normals, indices);
 		}
-#pragma warning(pop)
 	}
 }
\ No newline at end of file
@@ -1,9 +1,16 @@
 #pragma once
+#include <cassert>
+#include <cmath>
+#include "SIMD.h"
+#include "Vector3.h"
+
+#if defined(DAE_SIMD_X86)
+#include <xmmintrin.h>
+#endif
 
 namespace dae
 {
 	struct Vector2;
-	struct Vector3;
 	struct Vector4 final
 	{
 		float x;
@@ -34,4 +41,126 @@ namespace dae
 		float operator[](int index) const;
 		bool operator==(const Vector4& v) const;
 	};
+
+#if defined(DAE_SIMD_X86)
+	namespace SIMD
+	{
+		//Vector4 is not 16 byte aligned (Matrix rows and scene data pack it tightly), so these use unaligned moves
+		inline __m128 Load(const Vector4& v)
+		{
+			return _mm_loadu_ps(&v.x);
+		}
+
+		inline Vector4 Store(__m128 value)
+		{
+			Vector4 result;
+			_mm_storeu_ps(&result.x, value);
+			return result;
+		}
+
+		//Sums the lanes in x, y, z, w order so the result matches the scalar expression bit for bit
+		inline float HorizontalSum(__m128 value)
+		{
+			__m128 sum = _mm_add_ss(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(1, 1, 1, 1)));
+			sum = _mm_add_ss(sum, _mm_movehl_ps(value, value));
+			sum = _mm_add_ss(sum, _mm_shuffle_ps(value, value, _MM_SHUFFLE(3, 3, 3, 3)));
+			return _mm_cvtss_f32(sum);
+		}
+	}
+#endif
+
+#pragma region Inline Definitions
+	inline Vector4::Vector4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+	inline Vector4::Vector4(const Vector3& v, float _w) : x(v.x), y(v.y), z(v.z), w(_w) {}
+
+	inline float Vector4::Magnitude() const
+	{
+		return std::sqrt(SqrMagnitude());
+	}
+
+	inline float Vector4::SqrMagnitude() const
+	{
+		return Dot(*this, *this);
+	}
+
+	inline float Vector4::Normalize()
+	{
+		const float m = Magnitude();
+		*this = *this * (1.f / m);
+
+		return m;
+	}
+
+	inline Vector4 Vector4::Normalized() const
+	{
+		return *this * (1.f / Magnitude());
+	}
+
+	inline Vector3 Vector4::GetXYZ() const
+	{
+		return { x,y,z };
+	}
+
+	inline float Vector4::Dot(const Vector4& v1, const Vector4& v2)
+	{
+#if defined(DAE_SIMD_X86)
+		return SIMD::HorizontalSum(_mm_mul_ps(SIMD::Load(v1), SIMD::Load(v2)));
+#else
+		return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z + v1.w * v2.w;
+#endif
+	}
+
+	inline Vector4 Vector4::operator*(float scale) const
+	{
+#if defined(DAE_SIMD_X86)
+		return SIMD::Store(_mm_mul_ps(SIMD::Load(*this), _mm_set1_ps(scale)));
+#else
+		return { x * scale, y * scale, z * scale, w * scale };
+#endif
+	}
+
+	inline Vector4 Vector4::operator+(const Vector4& v) const
+	{
+#if defined(DAE_SIMD_X86)
+		return SIMD::Store(_mm_add_ps(SIMD::Load(*this), SIMD::Load(v)));
+#else
+		return { x + v.x, y + v.y, z + v.z, w + v.w };
+#endif
+	}
+
+	inline Vector4 Vector4::operator-(const Vector4& v) const
+	{
+#if defined(DAE_SIMD_X86)
+		return SIMD::Store(_mm_sub_ps(SIMD::Load(*this), SIMD::Load(v)));
+#else
+		return { x - v.x, y - v.y, z - v.z, w - v.w };
+#endif
+	}
+
+	inline Vector4& Vector4::operator+=(const Vector4& v)
+	{
+		*this = *this + v;
+		return *this;
+	}
+
+	inline float& Vector4::operator[](int index)
+	{
+		assert(index <= 3 && index >= 0);
+
+		if (index == 0)return x;
+		if (index == 1)return y;
+		if (index == 2)return z;
+		return w;
+	}
+
+	inline float Vector4::operator[](int index) const
+	{
+		assert(index <= 3 && index >= 0);
+
+		if (index == 0)return x;
+		if (index == 1)return y;
+		if (index == 2)return z;
+		return w;
+	}
+#pragma endregion
 }
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include "WideBVH.h"
+#include "DataTypes.h"
+#include "SIMD.h"
+
+#if defined(DAE_SIMD_X86)
+#include <immintrin.h>
+#endif
+
+namespace dae
+{
+	namespace GeometryUtils
+	{
+#if defined(DAE_SIMD_X86)
+#pragma region SSE
+		int SlabTest_WideBVHNode(const WideBVHNode4& node, const Ray& ray, const Vector3& inverseDirection, float distances[4])
+		{
+			const __m128 originX = _mm_set1_ps(ray.origin.x);
+			const __m128 originY = _mm_set1_ps(ray.origin.y);
+			const __m128 originZ = _mm_set1_ps(ray.origin.z);
+			const __m128 inverseX = _mm_set1_ps(inverseDirection.x);
+			const __m128 inverseY = _mm_set1_ps(inverseDirection.y);
+			const __m128 inverseZ = _mm_set1_ps(inverseDirection.z);
+
+			const __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minX), originX), inverseX);
+			const __m128 tx2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxX), originX), inverseX);
+			const __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minY), originY), inverseY);
+			const __m128 ty2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxY), originY), inverseY);
+			const __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minZ), originZ), inverseZ);
+			const __m128 tz2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxZ), originZ), inverseZ);
+
+			__m128 tmin = _mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2));
+			tmin = _mm_max_ps(tmin, _mm_min_ps(tz1, tz2));
+			__m128 tmax = _mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2));
+			tmax = _mm_min_ps(tmax, _mm_max_ps(tz1, tz2));
+
+			const __m128 hit = _mm_and_ps(_mm_cmple_ps(tmin, tmax),
+				_mm_and_ps(_mm_cmpge_ps(tmax, _mm_set1_ps(ray.min)), _mm_cmple_ps(tmin, _mm_set1_ps(ray.max))));
+
+			_mm_storeu_ps(distances, tmin);
+			return _mm_movemask_ps(hit) & ((1 << node.childCount) - 1);
+		}
+#pragma endregion
+#pragma region AVX2
+		DAE_TARGET_AVX2 int SlabTest_WideBVHNode(const WideBVHNode8& node, const Ray& ray, const Vector3& inverseDirection, float distances[8])
+		{
+			const __m256 originX = _mm256_set1_ps(ray.origin.x);
+			const __m256 originY = _mm256_set1_ps(ray.origin.y);
+			const __m256 originZ = _mm256_set1_ps(ray.origin.z);
+			const __m256 inverseX = _mm256_set1_ps(inverseDirection.x);
+			const __m256 inverseY = _mm256_set1_ps(inverseDirection.y);
+			const __m256 inverseZ = _mm256_set1_ps(inverseDirection.z);
+
+			//Not folded into bound * inverse - origin * inverse with an fmsub: for axis parallel rays that is inf - inf = NaN
+			//and the NaN slab never culls the child
+			const __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minX), originX), inverseX);
+			const __m256 tx2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxX), originX), inverseX);
+			const __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minY), originY), inverseY);
+			const __m256 ty2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxY), originY), inverseY);
+			const __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minZ), originZ), inverseZ);
+			const __m256 tz2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxZ), originZ), inverseZ);
+
+			__m256 tmin = _mm256_max_ps(_mm256_min_ps(tx1, tx2), _mm256_min_ps(ty1, ty2));
+			tmin = _mm256_max_ps(tmin, _mm256_min_ps(tz1, tz2));
+			__m256 tmax = _mm256_min_ps(_mm256_max_ps(tx1, tx2), _mm256_max_ps(ty1, ty2));
+			tmax = _mm256_min_ps(tmax, _mm256_max_ps(tz1, tz2));
+
+			const __m256 hit = _mm256_and_ps(_mm256_cmp_ps(tmin, tmax, _CMP_LE_OQ),
+				_mm256_and_ps(_mm256_cmp_ps(tmax, _mm256_set1_ps(ray.min), _CMP_GE_OQ), _mm256_cmp_ps(tmin, _mm256_set1_ps(ray.max), _CMP_LE_OQ)));
+
+			_mm256_storeu_ps(distances, tmin);
+			return _mm256_movemask_ps(hit) & ((1 << node.childCount) - 1);
+		}
+#pragma endregion
+#else
+#pragma region Scalar
+		template<int Width>
+		static int SlabTest_WideBVHNodeScalar(const WideBVHNode<Width>& node, const Ray& ray, const Vector3& inverseDirection, float distances[Width])
+		{
+			int hitMask = 0;
+			for (uint32_t child = 0; child < node.childCount; ++child)
+			{
+				const float tx1 = (node.minX[child] - ray.origin.x) * inverseDirection.x;
+				const float tx2 = (node.maxX[child] - ray.origin.x) * inverseDirection.x;
+				const float ty1 = (node.minY[child] - ray.origin.y) * inverseDirection.y;
+				const float ty2 = (node.maxY[child] - ray.origin.y) * inverseDirection.y;
+				const float tz1 = (node.minZ[child] - ray.origin.z) * inverseDirection.z;
+				const float tz2 = (node.maxZ[child] - ray.origin.z) * inverseDirection.z;
+
+				const float tmin = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::min(tz1, tz2));
+				const float tmax = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::max(tz1, tz2));
+
+				distances[child] = tmin;
+				if (tmin <= tmax && tmax >= ray.min && tmin <= ray.max)
+					hitMask |= 1 << child;
+			}
+			return hitMask;
+		}
+
+		int SlabTest_WideBVHNode(const WideBVHNode4& node, const Ray& ray, const Vector3& inverseDirection, float distances[4])
+		{
+			return SlabTest_WideBVHNodeScalar(node, ray, inverseDirection, distances);
+		}
+
+		int SlabTest_WideBVHNode(const WideBVHNode8& node, const Ray& ray, const Vector3& inverseDirection, float distances[8])
+		{
+			return SlabTest_WideBVHNodeScalar(node, ray, inverseDirection, distances);
+		}
+#pragma endregion
+#endif
+	}
+}
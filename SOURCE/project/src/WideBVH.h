@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include "Math.h"
+
+namespace dae
+{
+	struct Ray;
+
+	//Collapsed BVH node with Width children whose bounds are stored as structure of arrays,
+	//so one SIMD slab test covers all of them. Only the first childCount lanes are valid.
+	template<int Width>
+	struct alignas(Width * sizeof(float)) WideBVHNode final
+	{
+		static constexpr int WIDTH = Width;
+		//Set on children that reference a leaf of the binary BVH the node was collapsed from
+		static constexpr uint32_t LEAF_FLAG = 0x80000000u;
+
+		float minX[Width]{};
+		float minY[Width]{};
+		float minZ[Width]{};
+		float maxX[Width]{};
+		float maxY[Width]{};
+		float maxZ[Width]{};
+
+		uint32_t children[Width]{}; //Wide node index, or binary leaf node index | LEAF_FLAG
+		uint32_t childCount{};
+	};
+
+	using WideBVHNode4 = WideBVHNode<4>;
+	using WideBVHNode8 = WideBVHNode<8>;
+
+	namespace GeometryUtils
+	{
+		//Slab test of the ray against every child box. Returns a bit mask of the children overlapping [ray.min, ray.max]
+		//and writes each child's entry distance. The 4-wide version uses SSE, the 8-wide one AVX2.
+		int SlabTest_WideBVHNode(const WideBVHNode4& node, const Ray& ray, const Vector3& inverseDirection, float distances[4]);
+		int SlabTest_WideBVHNode(const WideBVHNode8& node, const Ray& ray, const Vector3& inverseDirection, float distances[8]);
+	}
+}
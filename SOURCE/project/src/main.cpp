@@ -4,10 +4,18 @@
 #undef main
 
 //Standard includes
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
 
 //Project includes
 #include "Timer.h"
+#include "BVHCache.h"
+#include "OBJLoader.h"
 #include "Renderer.h"
 #include "Scene.h"
 #if defined(_DEBUG)
@@ -16,44 +24,232 @@
 
 using namespace dae;
 
-void ShutDown(SDL_Window* pWindow)
+struct LaunchOptions
 {
-	SDL_DestroyWindow(pWindow);
-	SDL_Quit();
+	bool headless{ false };
+	std::string sceneName{ "bunny" };
+	uint32_t width{ 640 };
+	uint32_t height{ 480 };
+	uint32_t frameCount{ 1 };
+	std::string outputPath{ "RayTracing_Buffer.bmp" };
+	uint32_t threadCount{ 0 };
+	bool pinThreads{ false };
+	float timeStep{ 1.f / 30.f };
+	uint32_t baseSampleCount{ 1 };
+	uint32_t maxSampleCount{ 1 };
+	float varianceThreshold{ Renderer::DEFAULT_VARIANCE_THRESHOLD };
+	bool packetTracing{ true };
+	bool wavefront{ false };
+	std::string bvhCacheDirectory{};
+	BVHBuildMode bvhBuildMode{ BVHBuildMode::SAH };
+};
+
+void PrintUsage()
+{
+	std::cout << "Usage: RayTracer [options]\n"
+		<< "  --headless          render offline without a window and exit afterwards\n"
+		<< "  --scene <name>      bunny (default) or test\n"
+		<< "  --width <pixels>    default 640\n"
+		<< "  --height <pixels>   default 480\n"
+		<< "  --frames <count>    headless frames to render, default 1\n"
+		<< "  --output <file>     headless BMP output, multiple frames get _0000, _0001, ... appended\n"
+		<< "  --timestep <sec>    headless animation time per frame, default 1/30\n"
+		<< "  --threads <count>   render threads including the main thread, 0 (default) uses all\n"
+		<< "  --pin-threads       bind every render worker to its own core\n"
+		<< "  --samples <count>   headless samples every pixel starts with, default 1\n"
+		<< "  --max-samples <n>   headless adaptive supersampling limit for noisy pixels, default --samples\n"
+		<< "  --variance <value>  luminance variance a pixel has to drop below, default 0.0001\n"
+		<< "  --no-packets        trace primary rays one by one instead of in 8x8 packets\n"
+		<< "  --wavefront         render tiles in stages with hits shaded in batches per material\n"
+		<< "  --bvh-cache <dir>   store built mesh BVHs in dir and reuse them on later runs\n"
+		<< "  --bvh <mode>        mesh BVH build: sah (default), linear, treelets or spatial (static meshes, slowest build)\n";
 }
 
-int main(int argc, char* args[])
+bool ParseBVHBuildMode(const char* pName, BVHBuildMode& buildMode)
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	if (std::strcmp(pName, "sah") == 0)
+		buildMode = BVHBuildMode::SAH;
+	else if (std::strcmp(pName, "linear") == 0)
+		buildMode = BVHBuildMode::Linear;
+	else if (std::strcmp(pName, "treelets") == 0)
+		buildMode = BVHBuildMode::LinearTreelets;
+	else if (std::strcmp(pName, "spatial") == 0)
+		buildMode = BVHBuildMode::SpatialSplits;
+	else
+		return false;
+	return true;
+}
 
-	// Leak detection
-	#if defined(_DEBUG)
-		LeakDetector detector{};
-	#endif
+bool ParseOptions(int argc, char* args[], LaunchOptions& options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* pArgument = args[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (std::strcmp(pArgument, "--headless") == 0)
+			options.headless = true;
+		else if (std::strcmp(pArgument, "--pin-threads") == 0)
+			options.pinThreads = true;
+		else if (std::strcmp(pArgument, "--no-packets") == 0)
+			options.packetTracing = false;
+		else if (std::strcmp(pArgument, "--wavefront") == 0)
+			options.wavefront = true;
+		else if (std::strcmp(pArgument, "--scene") == 0 && hasValue)
+			options.sceneName = args[++i];
+		else if (std::strcmp(pArgument, "--width") == 0 && hasValue)
+			options.width = static_cast<uint32_t>(std::strtoul(args[++i], nullptr, 10));
+		else if (std::strcmp(pArgument, "--height") == 0 && hasValue)
+			options.height = static_cast<uint32_t>(std::strtoul(args[++i], nullptr, 10));
+		else if (std::strcmp(pArgument, "--frames") == 0 && hasValue)
+			options.frameCount = static_cast<uint32_t>(std::strtoul(args[++i], nullptr, 10));
+		else if (std::strcmp(pArgument, "--output") == 0 && hasValue)
+			options.outputPath = args[++i];
+		else if (std::strcmp(pArgument, "--timestep") == 0 && hasValue)
+			options.timeStep = std::strtof(args[++i], nullptr);
+		else if (std::strcmp(pArgument, "--threads") == 0 && hasValue)
+			options.threadCount = static_cast<uint32_t>(std::strtoul(args[++i], nullptr, 10));
+		else if (std::strcmp(pArgument, "--samples") == 0 && hasValue)
+			options.baseSampleCount = static_cast<uint32_t>(std::strtoul(args[++i], nullptr, 10));
+		else if (std::strcmp(pArgument, "--max-samples") == 0 && hasValue)
+			options.maxSampleCount = static_cast<uint32_t>(std::strtoul(args[++i], nullptr, 10));
+		else if (std::strcmp(pArgument, "--variance") == 0 && hasValue)
+			options.varianceThreshold = std::strtof(args[++i], nullptr);
+		else if (std::strcmp(pArgument, "--bvh-cache") == 0 && hasValue)
+			options.bvhCacheDirectory = args[++i];
+		else if (std::strcmp(pArgument, "--bvh") == 0 && hasValue)
+		{
+			if (!ParseBVHBuildMode(args[++i], options.bvhBuildMode))
+			{
+				std::cout << "Unknown BVH build mode: " << args[i] << "\n";
+				return false;
+			}
+		}
+		else
+		{
+			std::cout << "Unknown or incomplete option: " << pArgument << "\n";
+			return false;
+		}
+	}
+
+	if (options.width == 0 || options.height == 0 || options.frameCount == 0 || options.timeStep <= 0.f || options.baseSampleCount == 0)
+	{
+		std::cout << "Resolution, frame count, time step and sample count have to be positive\n";
+		return false;
+	}
+	options.maxSampleCount = std::max(options.maxSampleCount, options.baseSampleCount);
+	return true;
+}
+
+Scene* CreateScene(const std::string& sceneName)
+{
+	if (sceneName == "bunny")
+		return new Scene_W4_BunnyScene();
+	if (sceneName == "test")
+		return new Scene_W4_TestScene();
+
+	std::cout << "Unknown scene: " << sceneName << "\n";
+	return nullptr;
+}
+
+//Inserts the frame number before the extension when rendering more than one frame
+std::string GetFramePath(const std::string& outputPath, uint32_t frameIndex, uint32_t frameCount)
+{
+	if (frameCount == 1)
+		return outputPath;
+
+	char frameNumber[16]{};
+	std::snprintf(frameNumber, sizeof(frameNumber), "_%04u", frameIndex);
+
+	const size_t extensionStart = outputPath.find_last_of('.');
+	const size_t directoryEnd = outputPath.find_last_of("/\\");
+	if (extensionStart == std::string::npos || (directoryEnd != std::string::npos && extensionStart < directoryEnd))
+		return outputPath + frameNumber;
+	return outputPath.substr(0, extensionStart) + frameNumber + outputPath.substr(extensionStart);
+}
+
+//Loads the scene once the renderer exists, so OBJ parsing and big BVH builds run on its workers
+void InitializeScene(Scene* pScene, Renderer& renderer)
+{
+	BVH::SetThreadPool(&renderer.GetThreadPool());
+	//Only scene initialization loads OBJ files
+	Utils::SetOBJThreadPool(&renderer.GetThreadPool());
+	pScene->Initialize();
+	Utils::SetOBJThreadPool(nullptr);
+	pScene->BuildAccelerationStructure();
+}
+
+int RunHeadless(const LaunchOptions& options, Scene* pScene)
+{
+	Renderer renderer{ static_cast<int>(options.width), static_cast<int>(options.height), options.threadCount, options.pinThreads };
+	if (!renderer.IsValid())
+	{
+		std::cout << "Could not create a " << options.width << "x" << options.height << " render buffer: " << SDL_GetError() << std::endl;
+		return 1;
+	}
+	InitializeScene(pScene, renderer);
+	renderer.SetSupersampling(options.baseSampleCount, options.maxSampleCount, options.varianceThreshold);
+	if (!options.packetTracing)
+		renderer.TogglePacketTracing();
+	if (options.wavefront)
+		renderer.ToggleWavefrontRendering();
+
+	//Fixed time steps make every frame of a batch reproducible
+	Timer timer{};
+	timer.SetFixedTimeStep(options.timeStep);
+	timer.Start();
+
+	const auto startTime = std::chrono::steady_clock::now();
+	for (uint32_t frameIndex = 0; frameIndex < options.frameCount; ++frameIndex)
+	{
+		pScene->Update(&timer);
+		pScene->UpdateAccelerationStructure();
+
+		renderer.Render(pScene);
+		timer.Update();
 
+		const std::string framePath = GetFramePath(options.outputPath, frameIndex, options.frameCount);
+		if (renderer.SaveBufferToImage(framePath.c_str()))
+		{
+			std::cout << "Could not save " << framePath << ": " << SDL_GetError() << std::endl;
+			BVH::SetThreadPool(nullptr);
+			return 1;
+		}
+	}
+	const std::chrono::duration<double> totalTime = std::chrono::steady_clock::now() - startTime;
+
+	std::cout << "Rendered " << options.frameCount << " frame(s) at " << options.width << "x" << options.height
+		<< " in " << totalTime.count() << "s (" << totalTime.count() * 1000.0 / options.frameCount << "ms per frame)" << std::endl;
+
+	BVH::SetThreadPool(nullptr);
+	return 0;
+}
+
+int RunWindowed(const LaunchOptions& options, Scene* pScene)
+{
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
 
-	const uint32_t width = 640;
-	const uint32_t height = 480;
-
 	SDL_Window* pWindow = SDL_CreateWindow(
 		"RayTracer - Casper van Laer",
 		SDL_WINDOWPOS_UNDEFINED,
 		SDL_WINDOWPOS_UNDEFINED,
-		width, height, 0);
+		options.width, options.height, 0);
 
 	if (!pWindow)
+	{
+		SDL_Quit();
 		return 1;
+	}
 
 	const auto pTimer = new Timer();
-	const auto pRenderer = new Renderer(pWindow);
-
-	//const auto pScene = new Scene_W4_TestScene();
-	const auto pScene = new Scene_W4_BunnyScene();
-	pScene->Initialize();
+	const auto pRenderer = new Renderer(pWindow, options.threadCount, options.pinThreads);
+	InitializeScene(pScene, *pRenderer);
+	//Launch toggles set the starting state, the keys still flip them at runtime
+	if (!options.packetTracing)
+		pRenderer->TogglePacketTracing();
+	if (options.wavefront)
+		pRenderer->ToggleWavefrontRendering();
 
 	pTimer->Start();
 
@@ -78,12 +274,27 @@ int main(int argc, char* args[])
 					pRenderer->ToggleShadow();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F3)
 					pRenderer->SwitchLightingMode();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F4)
+					pRenderer->SwitchToneMapping();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F5)
+					pRenderer->ToggleGammaCorrection();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F6)
+					pScene->ToggleAnimation();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F7)
+					pRenderer->ToggleProgressiveRendering();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F8)
+					pRenderer->ToggleSupersampling();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F9)
+					pRenderer->TogglePacketTracing();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F10)
+					pRenderer->ToggleWavefrontRendering();
 				break;
 			}
 		}
 
 		//--------- Update ---------
 		pScene->Update(pTimer);
+		pScene->UpdateAccelerationStructure();
 
 		//--------- Render ---------
 		pRenderer->Render(pScene);
@@ -109,10 +320,38 @@ int main(int argc, char* args[])
 	}
 	pTimer->Stop();
 
-	delete pScene;
+	BVH::SetThreadPool(nullptr);
 	delete pRenderer;
 	delete pTimer;
 
-	ShutDown(pWindow);
+	SDL_DestroyWindow(pWindow);
+	SDL_Quit();
 	return 0;
-}
\ No newline at end of file
+}
+
+int main(int argc, char* args[])
+{
+	// Leak detection
+	#if defined(_DEBUG)
+		LeakDetector detector{};
+	#endif
+
+	LaunchOptions options{};
+	if (!ParseOptions(argc, args, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	BVHCache::SetDirectory(options.bvhCacheDirectory);
+	BVH::SetDefaultBuildMode(options.bvhBuildMode);
+
+	const auto pScene = CreateScene(options.sceneName);
+	if (!pScene)
+		return 1;
+
+	const int result = options.headless ? RunHeadless(options, pScene) : RunWindowed(options, pScene);
+
+	delete pScene;
+	return result;
+}